@@ -0,0 +1,118 @@
+#ifndef BITSET_H
+#define BITSET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* fixed-width sets of small integers, stored as arrays of 64-bit words.
+ * element @i occupies bit @i % 64 of word @i / 64.
+ */
+typedef uint64_t bits_t;
+
+/* bits_words(): get the number of words needed to hold @n elements.
+ */
+static inline int bits_words (int n) {
+  return (n + 63) / 64;
+}
+
+/* bits_set(): add element @i to the set @b.
+ */
+static inline void bits_set (bits_t *b, int i) {
+  b[i / 64] |= (bits_t) 1 << (i % 64);
+}
+
+/* bits_clear(): remove element @i from the set @b.
+ */
+static inline void bits_clear (bits_t *b, int i) {
+  b[i / 64] &= ~((bits_t) 1 << (i % 64));
+}
+
+/* bits_put(): add element @i to the set @b if @v is set, or remove it
+ * otherwise.
+ */
+static inline void bits_put (bits_t *b, int i, bool v) {
+  if (v)
+    bits_set(b, i);
+  else
+    bits_clear(b, i);
+}
+
+/* bits_test(): get whether element @i is in the set @b.
+ */
+static inline bool bits_test (const bits_t *b, int i) {
+  return (b[i / 64] >> (i % 64)) & 1;
+}
+
+/* bits_zero(): remove all elements from the @w-word set @b.
+ */
+static inline void bits_zero (bits_t *b, int w) {
+  memset(b, 0, w * sizeof(bits_t));
+}
+
+/* bits_copy(): copy the @w-word set @src into @dst.
+ */
+static inline void bits_copy (bits_t *dst, const bits_t *src, int w) {
+  memcpy(dst, src, w * sizeof(bits_t));
+}
+
+/* bits_union(): add all elements of the @w-word set @src into @dst,
+ * returning whether @dst changed.
+ */
+static inline bool bits_union (bits_t *dst, const bits_t *src, int w) {
+  bits_t changed = 0;
+
+  for (int i = 0; i < w; i++) {
+    bits_t d = dst[i] | src[i];
+    changed |= d ^ dst[i];
+    dst[i] = d;
+  }
+
+  return changed != 0;
+}
+
+/* bits_intersects(): get whether the @w-word sets @a and @b share any
+ * element.
+ */
+static inline bool bits_intersects (const bits_t *a, const bits_t *b, int w) {
+  for (int i = 0; i < w; i++) {
+    if (a[i] & b[i])
+      return true;
+  }
+
+  return false;
+}
+
+/* bits_count(): get the number of elements in the @w-word set @b.
+ */
+static inline int bits_count (const bits_t *b, int w) {
+  int n = 0;
+
+  for (int i = 0; i < w; i++)
+    n += __builtin_popcountll(b[i]);
+
+  return n;
+}
+
+/* bits_next(): get the smallest element of the @w-word set @b that is
+ * not less than @i, or -1 if there is none.
+ */
+static inline int bits_next (const bits_t *b, int w, int i) {
+  int k = i / 64;
+
+  if (k >= w)
+    return -1;
+
+  bits_t word = b[k] & (~(bits_t) 0 << (i % 64));
+
+  while (!word) {
+    if (++k >= w)
+      return -1;
+
+    word = b[k];
+  }
+
+  return k * 64 + __builtin_ctzll(word);
+}
+
+#endif
@@ -0,0 +1,675 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "compiled.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* compiled_align(): round a byte offset up to a multiple of eight, so
+ * that bitset sections may be accessed as 64-bit words.
+ */
+static uint32_t compiled_align (uint32_t off) {
+  return (off + 7) & ~(uint32_t) 7;
+}
+
+/* compiled_set_pack(): pack the terminals of the symbol array @sv into
+ * the bitset @bits of @words 64-bit words, each at its dense index.
+ */
+static void compiled_set_pack (grammar_t* g, uint64_t *bits, int words,
+                               int *sv) {
+  memset(bits, 0, words * sizeof(uint64_t));
+
+  for (int i = 0; i < symv_len(sv); i++) {
+    int d = g->dense[sv[i] - 1];
+
+    if (bits_test(g->sym_terminal, sv[i] - 1))
+      bits[d / 64] |= (uint64_t) 1 << (d % 64);
+  }
+}
+
+/* compiled_set_unpack(): get the interned symbol array holding every
+ * terminal whose bit is set in the bitset @bits of @words 64-bit words.
+ */
+static int *compiled_set_unpack (grammar_t* g, int cls,
+                                  const uint64_t *bits, int words) {
+  int n = 0;
+
+  for (int w = 0; w < words; w++)
+    n += __builtin_popcountll(bits[w]);
+
+  if (n == 0)
+    return NULL;
+
+  int *sv = (int*) mem_alloc(g, cls, (n + 1) * sizeof(int));
+  if (!sv)
+    return NULL;
+
+  n = 0;
+  for (int w = 0; w < words; w++) {
+    uint64_t word = bits[w];
+
+    while (word) {
+      int t = w * 64 + __builtin_ctzll(word);
+
+      if (t >= g->n_terms) {
+        mem_free(g, sv);
+        return NULL;
+      }
+
+      sv[n++] = g->terms[t];
+      word &= word - 1;
+    }
+  }
+
+  sv[n] = 0;
+  return symv_intern(g, cls, sv);
+}
+
+/* compiled_strtab_add(): append the string @s to the string table @tab
+ * of current size @n, returning the offset of the string.
+ */
+static uint32_t compiled_strtab_add (grammar_t* g, char **tab, uint32_t *n,
+                                     const char *s) {
+  uint32_t off = *n;
+  size_t len = strlen(s) + 1;
+
+  if (g->status)
+    return 0;
+
+  char *tnew = (char*) mem_realloc(g, MEM_TEMP, *tab, *n + len);
+  if (!tnew)
+    return 0;
+
+  *tab = tnew;
+  memcpy(*tab + off, s, len);
+  *n += len;
+
+  return off;
+}
+
+/* compiled_calloc(): allocate a zeroed temporary array of @n elements of
+ * @size bytes, with room for at least one element.
+ */
+static void *compiled_calloc (grammar_t* g, size_t n, size_t size) {
+  void *p = mem_alloc(g, MEM_TEMP, (n + 1) * size);
+
+  if (p)
+    memset(p, 0, (n + 1) * size);
+
+  return p;
+}
+
+/* compiled_write(): write the symbol table, productions, nullable flags
+ * and first, follow and predict sets of a fully analyzed grammar into
+ * a compiled image file named @fname.
+ */
+int compiled_write (grammar_t* g, const char *fname) {
+  struct compiled_header hdr;
+  char *strtab = NULL;
+  uint32_t n_strtab = 0;
+  int i, j;
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, COMPILED_MAGIC, 4);
+  hdr.version = COMPILED_VERSION;
+  hdr.set_words = (g->n_terms + 63) / 64;
+  hdr.n_symbols = g->n_symbols;
+  hdr.n_terms = g->n_terms;
+  hdr.n_nonterms = g->n_nonterms;
+  hdr.n_prods = g->n_prods;
+  hdr.n_aliases = g->alias_count;
+
+  hdr.n_rhs = g->n_rhs - g->n_prods;
+
+  /* lay out every section of the image. */
+  uint32_t set_bytes = hdr.set_words * sizeof(uint64_t);
+  hdr.off_symbols = sizeof(hdr);
+  hdr.off_aliases = hdr.off_symbols +
+                    hdr.n_symbols * sizeof(struct compiled_symbol);
+  hdr.off_prods = hdr.off_aliases +
+                  hdr.n_aliases * sizeof(struct compiled_alias);
+  hdr.off_rhs = hdr.off_prods +
+                hdr.n_prods * sizeof(struct compiled_production);
+  hdr.off_first = compiled_align(hdr.off_rhs + hdr.n_rhs * sizeof(uint32_t));
+  hdr.off_follow = hdr.off_first + hdr.n_nonterms * set_bytes;
+  hdr.off_predict = hdr.off_follow + hdr.n_nonterms * set_bytes;
+  hdr.off_strtab = hdr.off_predict + hdr.n_prods * set_bytes;
+
+  struct compiled_symbol *syms = (struct compiled_symbol*)
+    compiled_calloc(g, hdr.n_symbols, sizeof(struct compiled_symbol));
+  struct compiled_alias *als = (struct compiled_alias*)
+    compiled_calloc(g, hdr.n_aliases, sizeof(struct compiled_alias));
+  struct compiled_production *prods = (struct compiled_production*)
+    compiled_calloc(g, hdr.n_prods, sizeof(struct compiled_production));
+  uint32_t *rhs = (uint32_t*)
+    compiled_calloc(g, hdr.n_rhs, sizeof(uint32_t));
+  uint64_t *bits = (uint64_t*)
+    compiled_calloc(g, hdr.set_words, sizeof(uint64_t));
+
+  for (i = 0; i < g->n_symbols && !g->status; i++) {
+    syms[i].name = compiled_strtab_add(g, &strtab, &n_strtab,
+                                       g->symbols[i].name);
+    syms[i].is_terminal = bits_test(g->sym_terminal, i);
+    syms[i].derives_empty = bits_test(g->sym_empty, i);
+  }
+
+  for (i = 0; i < g->alias_count && !g->status; i++) {
+    als[i].from = compiled_strtab_add(g, &strtab, &n_strtab,
+                                      g->aliases[i].from);
+    als[i].to = compiled_strtab_add(g, &strtab, &n_strtab,
+                                    g->aliases[i].to);
+  }
+
+  for (i = 0, j = 0; i < g->n_prods && !g->status; i++) {
+    int *prhs = g->rhs + g->prod_off[i];
+    int n = g->prod_len[i];
+
+    prods[i].lhs = g->prod_lhs[i];
+    prods[i].rhs_off = j;
+    prods[i].rhs_len = n;
+    prods[i].derives_empty = bits_test(g->prod_empty, i);
+
+    for (int k = 0; k < n; k++)
+      rhs[j++] = prhs[k];
+  }
+
+  hdr.n_strtab = n_strtab;
+
+  FILE *fh = (g->status ? NULL : fopen(fname, "wb"));
+  if (!fh && !g->status)
+    grammar_fail(g, LL1_EIO, "%s: %s", fname, strerror(errno));
+
+  int ok = fh && fwrite(&hdr, sizeof(hdr), 1, fh) == 1;
+  ok = ok && fwrite(syms, sizeof(struct compiled_symbol),
+                    hdr.n_symbols, fh) == hdr.n_symbols;
+  ok = ok && fwrite(als, sizeof(struct compiled_alias),
+                    hdr.n_aliases, fh) == hdr.n_aliases;
+  ok = ok && fwrite(prods, sizeof(struct compiled_production),
+                    hdr.n_prods, fh) == hdr.n_prods;
+  ok = ok && fwrite(rhs, sizeof(uint32_t), hdr.n_rhs, fh) == hdr.n_rhs;
+
+  /* pad the rhs section out to the aligned bitset sections. */
+  for (uint32_t off = hdr.off_rhs + hdr.n_rhs * sizeof(uint32_t);
+       ok && off < hdr.off_first; off++)
+    ok = fputc(0, fh) != EOF;
+
+  for (i = 0; ok && i < g->n_nonterms; i++) {
+    compiled_set_pack(g, bits, hdr.set_words,
+                      g->symbols[g->nonterms[i] - 1].first);
+    ok = fwrite(bits, sizeof(uint64_t), hdr.set_words, fh) == hdr.set_words;
+  }
+
+  for (i = 0; ok && i < g->n_nonterms; i++) {
+    compiled_set_pack(g, bits, hdr.set_words,
+                      g->symbols[g->nonterms[i] - 1].follow);
+    ok = fwrite(bits, sizeof(uint64_t), hdr.set_words, fh) == hdr.set_words;
+  }
+
+  for (i = 0; ok && i < g->n_prods; i++) {
+    compiled_set_pack(g, bits, hdr.set_words, g->prods[i].predict);
+    ok = fwrite(bits, sizeof(uint64_t), hdr.set_words, fh) == hdr.set_words;
+  }
+
+  ok = ok && fwrite(strtab, 1, n_strtab, fh) == n_strtab;
+
+  if (fh && (fclose(fh) != 0 || !ok))
+    grammar_fail(g, LL1_EIO, "%s: unable to write compiled grammar", fname);
+
+  mem_free(g, syms);
+  mem_free(g, als);
+  mem_free(g, prods);
+  mem_free(g, rhs);
+  mem_free(g, bits);
+  mem_free(g, strtab);
+
+  return g->status;
+}
+
+/* compiled_string(): return a string at offset @off of the string table
+ * of a mapped image, or NULL if it does not lie within the table.
+ */
+static const char *compiled_string (const char *strtab, uint32_t n,
+                                    uint32_t off) {
+  if (off >= n || !memchr(strtab + off, '\0', n - off))
+    return NULL;
+
+  return strtab + off;
+}
+
+/* compiled_strdup(): duplicate the string at offset @off of the string
+ * table of a mapped image into @dst.
+ */
+static int compiled_strdup (grammar_t* g, char **dst, const char *strtab,
+                            uint32_t n, uint32_t off, const char *fname) {
+  const char *s = compiled_string(strtab, n, off);
+  if (!s)
+    return grammar_fail(g, LL1_EFORMAT, "%s: corrupt string table", fname);
+
+  *dst = mem_strdup(g, MEM_SYMBOLS, s);
+  return g->status;
+}
+
+/* compiled_load_image(): populate the grammar @g from the compiled image
+ * mapped at @base, having @size bytes.
+ */
+static int compiled_load_image (grammar_t* g, const char *base, size_t size,
+                                const char *fname) {
+  const struct compiled_header *hdr = (const struct compiled_header*) base;
+  int i;
+
+  if (size < sizeof(struct compiled_header) ||
+      memcmp(hdr->magic, COMPILED_MAGIC, 4) != 0)
+    return grammar_fail(g, LL1_EFORMAT, "%s: not a compiled grammar", fname);
+
+  if (hdr->version != COMPILED_VERSION)
+    return grammar_fail(g, LL1_EFORMAT,
+                        "%s: unsupported compiled grammar version %u",
+                        fname, hdr->version);
+
+  uint64_t set_bytes = (uint64_t) hdr->set_words * sizeof(uint64_t);
+  if (hdr->set_words != (hdr->n_terms + 63) / 64 ||
+      (uint64_t) hdr->n_terms + hdr->n_nonterms != hdr->n_symbols ||
+      hdr->off_symbols + (uint64_t) hdr->n_symbols *
+        sizeof(struct compiled_symbol) > size ||
+      hdr->off_aliases + (uint64_t) hdr->n_aliases *
+        sizeof(struct compiled_alias) > size ||
+      hdr->off_prods + (uint64_t) hdr->n_prods *
+        sizeof(struct compiled_production) > size ||
+      hdr->off_rhs + (uint64_t) hdr->n_rhs * sizeof(uint32_t) > size ||
+      hdr->off_symbols % 4 || hdr->off_aliases % 4 ||
+      hdr->off_prods % 4 || hdr->off_rhs % 4 ||
+      hdr->off_first % 8 || hdr->off_follow % 8 || hdr->off_predict % 8 ||
+      hdr->off_first + hdr->n_nonterms * set_bytes > size ||
+      hdr->off_follow + hdr->n_nonterms * set_bytes > size ||
+      hdr->off_predict + hdr->n_prods * set_bytes > size ||
+      hdr->off_strtab + (uint64_t) hdr->n_strtab > size)
+    return grammar_fail(g, LL1_EFORMAT, "%s: truncated compiled grammar",
+                        fname);
+
+  const struct compiled_symbol *syms = (const struct compiled_symbol*)
+    (base + hdr->off_symbols);
+  const struct compiled_alias *als = (const struct compiled_alias*)
+    (base + hdr->off_aliases);
+  const struct compiled_production *prods =
+    (const struct compiled_production*) (base + hdr->off_prods);
+  const uint32_t *rhs = (const uint32_t*) (base + hdr->off_rhs);
+  const uint64_t *first = (const uint64_t*) (base + hdr->off_first);
+  const uint64_t *follow = (const uint64_t*) (base + hdr->off_follow);
+  const uint64_t *pred = (const uint64_t*) (base + hdr->off_predict);
+  const char *strtab = base + hdr->off_strtab;
+
+  /* table counts only grow as entries are filled, so that the grammar
+   * may be freed at any point of a failed load.
+   */
+  symbols_resize(g, hdr->n_symbols);
+  g->aliases = (struct alias*)
+    mem_alloc(g, MEM_SYMBOLS, (hdr->n_aliases + 1) * sizeof(struct alias));
+
+  if (g->status)
+    return g->status;
+
+  for (i = 0; i < (int) hdr->n_symbols && !g->status; i++) {
+    struct symbol *sym = g->symbols + g->n_symbols++;
+
+    memset(sym, 0, sizeof(struct symbol));
+    compiled_strdup(g, &sym->name, strtab, hdr->n_strtab,
+                    syms[i].name, fname);
+
+    bits_put(g->sym_terminal, i, syms[i].is_terminal);
+    bits_put(g->sym_empty, i, syms[i].derives_empty);
+  }
+
+  if (g->status || symbols_number(g))
+    return g->status;
+
+  if (g->n_terms != (int) hdr->n_terms)
+    return grammar_fail(g, LL1_EFORMAT, "%s: corrupt symbol table", fname);
+
+  /* the first set of a terminal is the terminal itself. */
+  for (i = 0; i < g->n_symbols && !g->status; i++) {
+    struct symbol *sym = g->symbols + i;
+    int d = g->dense[i];
+
+    if (bits_test(g->sym_terminal, i))
+      sym->first = symv_intern(g, MEM_FIRST, symv_new(g, i + 1));
+    else {
+      sym->first = compiled_set_unpack(g, MEM_FIRST,
+                                       first + d * hdr->set_words,
+                                       hdr->set_words);
+      sym->follow = compiled_set_unpack(g, MEM_FOLLOW,
+                                        follow + d * hdr->set_words,
+                                        hdr->set_words);
+    }
+  }
+
+  for (i = 0; i < (int) hdr->n_aliases && !g->status; i++) {
+    struct alias *al = g->aliases + g->alias_count++;
+
+    memset(al, 0, sizeof(struct alias));
+    compiled_strdup(g, &al->from, strtab, hdr->n_strtab, als[i].from, fname);
+    compiled_strdup(g, &al->to, strtab, hdr->n_strtab, als[i].to, fname);
+  }
+
+  for (i = 0; i < (int) hdr->n_prods && !g->status; i++) {
+    uint32_t off = prods[i].rhs_off, len = prods[i].rhs_len;
+
+    if (prods[i].lhs < 1 || prods[i].lhs > hdr->n_symbols ||
+        (uint64_t) off + len > hdr->n_rhs)
+      return grammar_fail(g, LL1_EFORMAT, "%s: corrupt production table",
+                          fname);
+
+    int *prhs = prods_append(g, prods[i].lhs, len);
+    if (!prhs)
+      return g->status;
+
+    bits_put(g->prod_empty, i, prods[i].derives_empty);
+    g->prods[i].predict = compiled_set_unpack(g, MEM_PREDICT,
+                                              pred + i * hdr->set_words,
+                                              hdr->set_words);
+
+    for (uint32_t k = 0; k < len; k++) {
+      if (rhs[off + k] < 1 || rhs[off + k] > hdr->n_symbols)
+        return grammar_fail(g, LL1_EFORMAT, "%s: corrupt production table",
+                            fname);
+
+      prhs[k] = rhs[off + k];
+    }
+  }
+
+  return g->status;
+}
+
+/* compiled_map(): map the whole image file @fname into memory, storing
+ * its size in @size. returns NULL on failure.
+ */
+static const char *compiled_map (grammar_t* g, const char *fname,
+                                 size_t *size) {
+  struct stat st;
+
+  int fd = open(fname, O_RDONLY);
+  if (fd < 0) {
+    grammar_fail(g, LL1_EIO, "%s: %s", fname, strerror(errno));
+    return NULL;
+  }
+
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    grammar_fail(g, LL1_EIO, "%s: %s", fname, strerror(errno));
+    return NULL;
+  }
+
+  *size = st.st_size;
+  if (*size == 0) {
+    close(fd);
+    grammar_fail(g, LL1_EFORMAT, "%s: not a compiled grammar", fname);
+    return NULL;
+  }
+
+  void *base = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (base == MAP_FAILED) {
+    grammar_fail(g, LL1_EIO, "%s: %s", fname, strerror(errno));
+    return NULL;
+  }
+
+  return (const char*) base;
+}
+
+/* compiled_load(): map the compiled image file @fname and populate the
+ * (freshly initialized) grammar @g with copies of its symbols,
+ * productions and precomputed sets, without re-parsing or re-analyzing
+ * the grammar. the image is unmapped once loaded.
+ */
+int compiled_load (grammar_t* g, const char *fname) {
+  size_t size;
+
+  grammar_phase(g, PHASE_LOAD);
+
+  const char *base = compiled_map(g, fname, &size);
+  if (base) {
+    compiled_load_image(g, base, size, fname);
+    munmap((void*) base, size);
+  }
+
+  return g->status;
+}
+
+/* compiled_write_module(): write the symbols, productions, includes and
+ * aliases parsed from a single module into @g as a cached module image
+ * named @fname, tagged with the hash @key of its text. the first
+ * @n_inherited aliases of @g were declared by earlier modules, and are
+ * left out. the image is written under a temporary name and then moved
+ * into place, so that a concurrent reader never sees it half written.
+ */
+int compiled_write_module (grammar_t* g, const char *fname, uint64_t key,
+                           int n_inherited) {
+  struct module_header hdr;
+  char *strtab = NULL;
+  uint32_t n_strtab = 0;
+  int i, j;
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, MODULE_MAGIC, 4);
+  hdr.version = MODULE_VERSION;
+  hdr.key = key;
+  hdr.n_symbols = g->n_symbols;
+  hdr.n_prods = g->n_prods;
+  hdr.n_aliases = g->alias_count - n_inherited;
+  hdr.n_includes = g->n_includes;
+  hdr.n_rhs = g->n_rhs - g->n_prods;
+
+  /* lay out every section of the image. */
+  hdr.off_symbols = sizeof(hdr);
+  hdr.off_prods = hdr.off_symbols +
+                  hdr.n_symbols * sizeof(struct compiled_symbol);
+  hdr.off_aliases = hdr.off_prods +
+                    hdr.n_prods * sizeof(struct compiled_production);
+  hdr.off_includes = hdr.off_aliases +
+                     hdr.n_aliases * sizeof(struct compiled_alias);
+  hdr.off_rhs = hdr.off_includes + hdr.n_includes * sizeof(uint32_t);
+  hdr.off_strtab = hdr.off_rhs + hdr.n_rhs * sizeof(uint32_t);
+
+  struct compiled_symbol *syms = (struct compiled_symbol*)
+    compiled_calloc(g, hdr.n_symbols, sizeof(struct compiled_symbol));
+  struct compiled_production *prods = (struct compiled_production*)
+    compiled_calloc(g, hdr.n_prods, sizeof(struct compiled_production));
+  struct compiled_alias *als = (struct compiled_alias*)
+    compiled_calloc(g, hdr.n_aliases, sizeof(struct compiled_alias));
+  uint32_t *incs = (uint32_t*)
+    compiled_calloc(g, hdr.n_includes, sizeof(uint32_t));
+  uint32_t *rhs = (uint32_t*)
+    compiled_calloc(g, hdr.n_rhs, sizeof(uint32_t));
+
+  for (i = 0; i < g->n_symbols && !g->status; i++) {
+    syms[i].name = compiled_strtab_add(g, &strtab, &n_strtab,
+                                       g->symbols[i].name);
+    syms[i].is_terminal = bits_test(g->sym_terminal, i);
+  }
+
+  for (i = 0, j = 0; i < g->n_prods && !g->status; i++) {
+    int *prhs = g->rhs + g->prod_off[i];
+    int n = g->prod_len[i];
+
+    prods[i].lhs = g->prod_lhs[i];
+    prods[i].rhs_off = j;
+    prods[i].rhs_len = n;
+
+    for (int k = 0; k < n; k++)
+      rhs[j++] = prhs[k];
+  }
+
+  for (i = 0; i < (int) hdr.n_aliases && !g->status; i++) {
+    struct alias *al = g->aliases + n_inherited + i;
+
+    als[i].from = compiled_strtab_add(g, &strtab, &n_strtab, al->from);
+    als[i].to = compiled_strtab_add(g, &strtab, &n_strtab, al->to);
+  }
+
+  for (i = 0; i < g->n_includes && !g->status; i++)
+    incs[i] = compiled_strtab_add(g, &strtab, &n_strtab, g->includes[i]);
+
+  hdr.n_strtab = n_strtab;
+
+  size_t len = strlen(fname) + 32;
+  char *tmp = (char*) mem_alloc(g, MEM_TEMP, len);
+  if (tmp)
+    snprintf(tmp, len, "%s.%ld", fname, (long) getpid());
+
+  FILE *fh = (g->status ? NULL : fopen(tmp, "wb"));
+  if (!fh && !g->status)
+    grammar_fail(g, LL1_EIO, "%s: %s", tmp, strerror(errno));
+
+  int ok = fh && fwrite(&hdr, sizeof(hdr), 1, fh) == 1;
+  ok = ok && fwrite(syms, sizeof(struct compiled_symbol),
+                    hdr.n_symbols, fh) == hdr.n_symbols;
+  ok = ok && fwrite(prods, sizeof(struct compiled_production),
+                    hdr.n_prods, fh) == hdr.n_prods;
+  ok = ok && fwrite(als, sizeof(struct compiled_alias),
+                    hdr.n_aliases, fh) == hdr.n_aliases;
+  ok = ok && fwrite(incs, sizeof(uint32_t),
+                    hdr.n_includes, fh) == hdr.n_includes;
+  ok = ok && fwrite(rhs, sizeof(uint32_t), hdr.n_rhs, fh) == hdr.n_rhs;
+  ok = ok && fwrite(strtab, 1, n_strtab, fh) == n_strtab;
+
+  if (fh && (fclose(fh) != 0 || !ok || rename(tmp, fname) != 0)) {
+    remove(tmp);
+    grammar_fail(g, LL1_EIO, "%s: unable to write cached module", fname);
+  }
+
+  mem_free(g, syms);
+  mem_free(g, prods);
+  mem_free(g, als);
+  mem_free(g, incs);
+  mem_free(g, rhs);
+  mem_free(g, strtab);
+  mem_free(g, tmp);
+
+  return g->status;
+}
+
+/* compiled_load_module_image(): populate the grammar @g from the cached
+ * module image mapped at @base, having @size bytes.
+ */
+static int compiled_load_module_image (grammar_t* g, const char *base,
+                                       size_t size, const char *fname,
+                                       uint64_t key) {
+  const struct module_header *hdr = (const struct module_header*) base;
+  int i;
+
+  if (size < sizeof(struct module_header) ||
+      memcmp(hdr->magic, MODULE_MAGIC, 4) != 0)
+    return grammar_fail(g, LL1_EFORMAT, "%s: not a cached module", fname);
+
+  if (hdr->version != MODULE_VERSION)
+    return grammar_fail(g, LL1_EFORMAT,
+                        "%s: unsupported cached module version %u",
+                        fname, hdr->version);
+
+  if (hdr->key != key)
+    return grammar_fail(g, LL1_EFORMAT, "%s: stale cached module", fname);
+
+  if (hdr->off_symbols + (uint64_t) hdr->n_symbols *
+        sizeof(struct compiled_symbol) > size ||
+      hdr->off_prods + (uint64_t) hdr->n_prods *
+        sizeof(struct compiled_production) > size ||
+      hdr->off_aliases + (uint64_t) hdr->n_aliases *
+        sizeof(struct compiled_alias) > size ||
+      hdr->off_includes + (uint64_t) hdr->n_includes *
+        sizeof(uint32_t) > size ||
+      hdr->off_rhs + (uint64_t) hdr->n_rhs * sizeof(uint32_t) > size ||
+      hdr->off_symbols % 4 || hdr->off_prods % 4 ||
+      hdr->off_aliases % 4 || hdr->off_includes % 4 || hdr->off_rhs % 4 ||
+      hdr->off_strtab + (uint64_t) hdr->n_strtab > size)
+    return grammar_fail(g, LL1_EFORMAT, "%s: truncated cached module",
+                        fname);
+
+  const struct compiled_symbol *syms = (const struct compiled_symbol*)
+    (base + hdr->off_symbols);
+  const struct compiled_production *prods =
+    (const struct compiled_production*) (base + hdr->off_prods);
+  const struct compiled_alias *als = (const struct compiled_alias*)
+    (base + hdr->off_aliases);
+  const uint32_t *incs = (const uint32_t*) (base + hdr->off_includes);
+  const uint32_t *rhs = (const uint32_t*) (base + hdr->off_rhs);
+  const char *strtab = base + hdr->off_strtab;
+
+  if (symbols_resize(g, hdr->n_symbols))
+    return g->status;
+
+  for (i = 0; i < (int) hdr->n_symbols && !g->status; i++) {
+    struct symbol *sym = g->symbols + g->n_symbols++;
+
+    memset(sym, 0, sizeof(struct symbol));
+    compiled_strdup(g, &sym->name, strtab, hdr->n_strtab,
+                    syms[i].name, fname);
+
+    bits_put(g->sym_terminal, i, syms[i].is_terminal);
+  }
+
+  for (i = 0; i < (int) hdr->n_prods && !g->status; i++) {
+    uint32_t off = prods[i].rhs_off, len = prods[i].rhs_len;
+
+    if (prods[i].lhs < 1 || prods[i].lhs > hdr->n_symbols ||
+        (uint64_t) off + len > hdr->n_rhs)
+      return grammar_fail(g, LL1_EFORMAT, "%s: corrupt production table",
+                          fname);
+
+    int *prhs = prods_append(g, prods[i].lhs, len);
+    if (!prhs)
+      return g->status;
+
+    for (uint32_t k = 0; k < len; k++) {
+      if (rhs[off + k] < 1 || rhs[off + k] > hdr->n_symbols)
+        return grammar_fail(g, LL1_EFORMAT, "%s: corrupt production table",
+                            fname);
+
+      prhs[k] = rhs[off + k];
+    }
+  }
+
+  for (i = 0; i < (int) hdr->n_aliases && !g->status; i++) {
+    char *from = NULL, *to = NULL;
+
+    compiled_strdup(g, &from, strtab, hdr->n_strtab, als[i].from, fname);
+    compiled_strdup(g, &to, strtab, hdr->n_strtab, als[i].to, fname);
+
+    if (g->status) {
+      mem_free(g, from);
+      mem_free(g, to);
+    }
+    else
+      aliases_add(g, from, to);
+  }
+
+  for (i = 0; i < (int) hdr->n_includes && !g->status; i++) {
+    char *name = NULL;
+
+    if (!compiled_strdup(g, &name, strtab, hdr->n_strtab, incs[i], fname))
+      includes_add(g, name);
+  }
+
+  return g->status;
+}
+
+/* compiled_load_module(): map the cached module image file @fname and
+ * populate the (freshly initialized) grammar @g with what was parsed
+ * from the module, failing unless the image was tagged with @key.
+ */
+int compiled_load_module (grammar_t* g, const char *fname, uint64_t key) {
+  size_t size;
+
+  const char *base = compiled_map(g, fname, &size);
+  if (base) {
+    compiled_load_module_image(g, base, size, fname, key);
+    munmap((void*) base, size);
+  }
+
+  return g->status;
+}
@@ -0,0 +1,102 @@
+#ifndef COMPILED_H
+#define COMPILED_H
+
+#include <stdint.h>
+
+#include "grammar.h"
+
+/* compiled images are mapped and checked, but not used in place: loading
+ * copies every symbol name, production and alias into the structures of
+ * a fresh grammar, and unpacks and interns every stored bitset as a set.
+ * it thus takes time and memory linear in the size of the image, about
+ * three times that size at its peak, in exchange for a grammar that is
+ * no different from a parsed one. it still skips the parse and analysis,
+ * which cost far more.
+ */
+
+/* magic bytes and format version of compiled grammar images. */
+#define COMPILED_MAGIC "LL1C"
+#define COMPILED_VERSION 2
+
+/* magic bytes and format version of cached module images. */
+#define MODULE_MAGIC "LL1M"
+#define MODULE_VERSION 2
+
+/* compiled_header: fixed-size header at the start of a compiled grammar
+ * image. all section offsets are in bytes from the start of the image.
+ */
+struct compiled_header {
+  /* @magic: file identification bytes.
+   * @version: format version of the image.
+   * @set_words: number of 64-bit words in every stored bitset. sets
+   * hold terminals only, by their dense index, and first and follow
+   * sets are stored for nonterminals only, in dense order.
+   */
+  char magic[4];
+  uint32_t version;
+  uint32_t set_words;
+
+  /* element counts of each table in the image. */
+  uint32_t n_symbols, n_prods, n_aliases, n_rhs, n_strtab;
+  uint32_t n_terms, n_nonterms;
+
+  /* byte offsets of each section in the image. */
+  uint32_t off_symbols, off_aliases, off_prods, off_rhs;
+  uint32_t off_first, off_follow, off_predict, off_strtab;
+};
+
+/* compiled_symbol: symbol table entry of a compiled image. */
+struct compiled_symbol {
+  uint32_t name;
+  uint32_t is_terminal;
+  uint32_t derives_empty;
+};
+
+/* compiled_alias: alias table entry of a compiled image. */
+struct compiled_alias {
+  uint32_t from, to;
+};
+
+/* compiled_production: flattened production of a compiled image. the
+ * right-hand side is stored as @rhs_len one-based symbol indices
+ * starting at index @rhs_off of the rhs section.
+ */
+struct compiled_production {
+  uint32_t lhs;
+  uint32_t rhs_off, rhs_len;
+  uint32_t derives_empty;
+};
+
+/* module_header: fixed-size header at the start of a cached module
+ * image, holding what was parsed from a single grammar module. symbols,
+ * productions and aliases use the entries of compiled images, with no
+ * nullable flags, and includes are string table offsets.
+ */
+struct module_header {
+  /* @magic: file identification bytes.
+   * @version: format version of the image.
+   * @key: hash of the module text and of the aliases in scope when it
+   * was parsed.
+   */
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+
+  /* element counts of each table in the image. */
+  uint32_t n_symbols, n_prods, n_aliases, n_includes, n_rhs, n_strtab;
+
+  /* byte offsets of each section in the image. */
+  uint32_t off_symbols, off_prods, off_aliases, off_includes;
+  uint32_t off_rhs, off_strtab;
+};
+
+/* pre-declare compiled image functions. */
+int compiled_write (grammar_t* g, const char *fname);
+int compiled_load (grammar_t* g, const char *fname);
+
+/* pre-declare cached module image functions. */
+int compiled_write_module (grammar_t* g, const char *fname, uint64_t key,
+                           int n_inherited);
+int compiled_load_module (grammar_t* g, const char *fname, uint64_t key);
+
+#endif
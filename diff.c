@@ -0,0 +1,344 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "diff.h"
+#include "bitset.h"
+#include "grammar.h"
+#include "main.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* data structure for holding one pair of productions @prod1 and @prod2
+ * of the nonterminal @lhs whose predict sets share the symbols @overlap.
+ */
+struct conflict {
+  int lhs, prod1, prod2;
+  int *overlap;
+};
+
+/* data structure for holding the outcome of running one engine over one
+ * grammar text.
+ */
+struct run {
+  grammar_t g;
+  double seconds;
+  struct conflict *conflicts;
+  int n_conflicts;
+};
+
+/* now(): get a monotonic timestamp in seconds.
+ */
+static double now (void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* run_conflicts(): record every pair of productions of the same
+ * nonterminal having overlapping predict sets in the run @r, ordered
+ * by production index.
+ */
+static void run_conflicts (struct run *r) {
+  grammar_t *g = &r->g;
+  int cap = 0;
+
+  for (int j1 = 0; j1 < g->n_prods && !g->status; j1++) {
+    for (int j2 = j1 + 1; j2 < g->n_prods && !g->status; j2++) {
+      if (g->prod_lhs[j1] != g->prod_lhs[j2])
+        continue;
+
+      int *overlap = symv_intersect(g, g->prods[j1].predict,
+                                    g->prods[j2].predict);
+      int n = symv_len(overlap);
+
+      if (n && r->n_conflicts == cap) {
+        cap = (cap ? 2 * cap : 16);
+        r->conflicts = (struct conflict*)
+          realloc(r->conflicts, cap * sizeof(struct conflict));
+        if (!r->conflicts)
+          derp("unable to allocate conflict list");
+      }
+
+      if (n) {
+        struct conflict *c = r->conflicts + r->n_conflicts++;
+        c->lhs = g->prod_lhs[j1];
+        c->prod1 = j1;
+        c->prod2 = j2;
+
+        c->overlap = (int*) malloc((n + 1) * sizeof(int));
+        if (!c->overlap)
+          derp("unable to allocate conflict list");
+
+        memcpy(c->overlap, overlap, (n + 1) * sizeof(int));
+      }
+
+      mem_free(g, overlap);
+    }
+  }
+}
+
+/* run_engine(): parse the grammar @text named @name and analyze it with
+ * @engine, timing the analysis alone.
+ */
+static int run_engine (struct run *r, int engine, const char *name,
+                       const char *text, size_t len) {
+  grammar_init(&r->g);
+  r->g.engine = engine;
+  r->conflicts = NULL;
+  r->n_conflicts = 0;
+
+  if (grammar_parse_buffer(&r->g, name, text, len))
+    return r->g.status;
+
+  double t0 = now();
+  if (!derives_empty(&r->g) && !first(&r->g) && !follow(&r->g))
+    predict(&r->g);
+
+  run_conflicts(r);
+  r->seconds = now() - t0;
+
+  return r->g.status;
+}
+
+/* run_free(): free the grammar and conflict list of the run @r.
+ */
+static void run_free (struct run *r) {
+  for (int i = 0; i < r->n_conflicts; i++)
+    free(r->conflicts[i].overlap);
+
+  free(r->conflicts);
+  grammar_free(&r->g);
+}
+
+/* same_set(): get whether two symbol arrays hold the same symbols,
+ * regardless of their order.
+ */
+static int same_set (const int *a, const int *b, int n_symbols) {
+  int w = bits_words(n_symbols), same;
+
+  if (symv_len(a) != symv_len(b))
+    return 0;
+
+  bits_t *ba = (bits_t*) calloc(2 * w + 1, sizeof(bits_t));
+  bits_t *bb = ba + w;
+  if (!ba)
+    derp("unable to allocate set buffers");
+
+  for (int i = 0; i < symv_len(a); i++) {
+    bits_set(ba, a[i] - 1);
+    bits_set(bb, b[i] - 1);
+  }
+
+  same = (memcmp(ba, bb, w * sizeof(bits_t)) == 0);
+  free(ba);
+
+  return same;
+}
+
+/* compare(): report every difference between the results of the
+ * reference run @ref and the optimized run @opt, returning their number.
+ */
+static int compare (const char *name, struct run *ref, struct run *opt) {
+  grammar_t *a = &ref->g, *b = &opt->g;
+  int n = a->n_symbols, k = 0;
+
+  if (a->n_symbols != b->n_symbols || a->n_prods != b->n_prods ||
+      a->n_rhs != b->n_rhs) {
+    fprintf(stderr, "%s: grammar tables differ\n", name);
+    return 1;
+  }
+
+  for (int i = 0; i < n; i++) {
+    const char *sym = a->symbols[i].name;
+
+    if (bits_test(a->sym_empty, i) != bits_test(b->sym_empty, i))
+      k++, fprintf(stderr, "%s: empty(%s) differs\n", name, sym);
+
+    if (!same_set(a->symbols[i].first, b->symbols[i].first, n))
+      k++, fprintf(stderr, "%s: first(%s) differs\n", name, sym);
+
+    if (!same_set(a->symbols[i].follow, b->symbols[i].follow, n))
+      k++, fprintf(stderr, "%s: follow(%s) differs\n", name, sym);
+  }
+
+  for (int i = 0; i < a->n_prods; i++) {
+    if (bits_test(a->prod_empty, i) != bits_test(b->prod_empty, i) ||
+        a->prod_yield[i] != b->prod_yield[i])
+      k++, fprintf(stderr, "%s: empty(production %d) differs\n", name, i);
+
+    if (!same_set(a->prods[i].predict, b->prods[i].predict, n))
+      k++, fprintf(stderr, "%s: predict(production %d) differs\n", name, i);
+  }
+
+  for (int i = 0; i < a->n_rhs; i++) {
+    if (bits_test(a->suffix_empty, i) != bits_test(b->suffix_empty, i))
+      k++, fprintf(stderr, "%s: empty(suffix %d) differs\n", name, i);
+
+    if (!same_set(a->suffix_first[i], b->suffix_first[i], n))
+      k++, fprintf(stderr, "%s: first(suffix %d) differs\n", name, i);
+  }
+
+  if (ref->n_conflicts != opt->n_conflicts)
+    k++, fprintf(stderr, "%s: conflicts differ (%d vs %d)\n", name,
+                 ref->n_conflicts, opt->n_conflicts);
+
+  for (int i = 0; i < ref->n_conflicts && i < opt->n_conflicts; i++) {
+    struct conflict *ca = ref->conflicts + i, *cb = opt->conflicts + i;
+
+    if (ca->lhs != cb->lhs || ca->prod1 != cb->prod1 ||
+        ca->prod2 != cb->prod2 || !same_set(ca->overlap, cb->overlap, n))
+      k++, fprintf(stderr, "%s: conflict(productions %d, %d) differs\n",
+                   name, ca->prod1, ca->prod2);
+  }
+
+  return k;
+}
+
+/* rng(): advance the xorshift generator state @x and return its output.
+ */
+static unsigned int rng (unsigned int *x) {
+  *x ^= *x << 13;
+  *x ^= *x >> 17;
+  *x ^= *x << 5;
+
+  return *x;
+}
+
+/* generate(): write a random grammar of up to @size nonterminals into a
+ * newly allocated string, drawing from the generator state @seed.
+ */
+static char *generate (int size, unsigned int *seed) {
+  char *text = NULL;
+  size_t len = 0;
+
+  FILE *fh = open_memstream(&text, &len);
+  if (!fh)
+    derp("unable to generate grammar: %s", strerror(errno));
+
+  int n_nt = 1 + rng(seed) % size;
+  int n_t = 1 + rng(seed) % 12;
+
+  fprintf(fh, "%%%%\n");
+  for (int i = 0; i < n_nt; i++) {
+    int n_alts = 1 + rng(seed) % 4;
+
+    fprintf(fh, "n%d :", i);
+    for (int a = 0; a < n_alts; a++) {
+      int n_rhs = rng(seed) % 5;
+
+      if (a)
+        fprintf(fh, "\n   |");
+
+      if (n_rhs == 0)
+        fprintf(fh, " %%empty");
+
+      for (int j = 0; j < n_rhs; j++) {
+        if (rng(seed) % 2)
+          fprintf(fh, " n%d", rng(seed) % n_nt);
+        else
+          fprintf(fh, " t%d", rng(seed) % n_t);
+      }
+    }
+
+    fprintf(fh, " ;\n");
+  }
+
+  fclose(fh);
+  return text;
+}
+
+/* read_file(): read the whole file @fname into a newly allocated string.
+ */
+static char *read_file (const char *fname, size_t *len) {
+  FILE *fh = fopen(fname, "r");
+  char *text = NULL;
+
+  if (!fh)
+    derp("%s: %s", fname, strerror(errno));
+
+  fseek(fh, 0, SEEK_END);
+  *len = ftell(fh);
+  fseek(fh, 0, SEEK_SET);
+
+  text = (char*) malloc(*len + 1);
+  if (!text || fread(text, 1, *len, fh) != *len)
+    derp("%s: unable to read file", fname);
+
+  text[*len] = '\0';
+  fclose(fh);
+
+  return text;
+}
+
+/* diff_one(): run both engines over a single grammar text and report the
+ * outcome. returns the number of differences.
+ */
+static int diff_one (const char *name, const char *text, size_t len,
+                     double *t_ref, double *t_opt) {
+  struct run ref, opt;
+  int k;
+
+  run_engine(&ref, ENGINE_REFERENCE, name, text, len);
+  run_engine(&opt, ENGINE_OPTIMIZED, name, text, len);
+
+  if (ref.g.status || opt.g.status) {
+    k = (ref.g.status != opt.g.status);
+    printf("  %-28s skipped: %s\n", name, grammar_error(&ref.g));
+  }
+  else {
+    k = compare(name, &ref, &opt);
+    *t_ref += ref.seconds;
+    *t_opt += opt.seconds;
+
+    printf("  %-28s %-8s %10.6fs %10.6fs %8.1fx\n", name,
+           k ? "MISMATCH" : "ok", ref.seconds, opt.seconds,
+           opt.seconds > 0 ? ref.seconds / opt.seconds : 0.0);
+  }
+
+  run_free(&ref);
+  run_free(&opt);
+
+  return k;
+}
+
+/* diff_run(): run the reference and optimized engines over the grammar
+ * @files and @n_generate random grammars of up to @size nonterminals,
+ * comparing every set and conflict. returns nonzero on any difference.
+ */
+int diff_run (int n_files, char **files, int n_generate, int size,
+              unsigned int seed) {
+  double t_ref = 0.0, t_opt = 0.0;
+  char name[64];
+  int k = 0;
+
+  if (seed == 0)
+    seed = 1;
+
+  printf("  %-28s %-8s %11s %11s %9s\n", "grammar", "result",
+         "reference", "optimized", "speedup");
+
+  for (int i = 0; i < n_files; i++) {
+    size_t len;
+    char *text = read_file(files[i], &len);
+
+    k += diff_one(files[i], text, len, &t_ref, &t_opt);
+    free(text);
+  }
+
+  for (int i = 0; i < n_generate; i++) {
+    char *text = generate(size, &seed);
+
+    snprintf(name, sizeof(name), "generated #%d", i + 1);
+    k += diff_one(name, text, strlen(text), &t_ref, &t_opt);
+    free(text);
+  }
+
+  printf("\n  %d grammars, %d differences, total speedup %.1fx\n\n",
+         n_files + n_generate, k, t_opt > 0 ? t_ref / t_opt : 0.0);
+
+  return (k ? 1 : 0);
+}
@@ -0,0 +1,8 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+/* pre-declare differential harness functions. */
+int diff_run (int n_files, char **files, int n_generate, int size,
+              unsigned int seed);
+
+#endif
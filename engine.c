@@ -0,0 +1,512 @@
+#include "engine.h"
+#include "bitset.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* the optimized engine replaces the recursive, visited-flag driven walks
+ * of the reference engine by relations between symbols, solved once with
+ * the digraph algorithm of DeRemer and Pennello over bitsets. sets only
+ * ever hold terminals, so every set has one bit per terminal, at its
+ * dense index, and relations are only built between nonterminals.
+ */
+
+/* relation_build(): build the relation over @n nodes holding the @m
+ * pairs (@src[k], @dst[k]).
+ */
+int relation_build (grammar_t* g, struct relation *r, int n, int m,
+                    const int *src, const int *dst) {
+  r->start = (int*) mem_alloc(g, MEM_TEMP, (n + 1) * sizeof(int));
+  r->adj = (int*) mem_alloc(g, MEM_TEMP, (m + 1) * sizeof(int));
+
+  if (g->status)
+    return g->status;
+
+  memset(r->start, 0, (n + 1) * sizeof(int));
+
+  for (int k = 0; k < m; k++)
+    r->start[src[k] + 1]++;
+
+  for (int x = 0; x < n; x++)
+    r->start[x + 1] += r->start[x];
+
+  for (int k = 0; k < m; k++)
+    r->adj[r->start[src[k]]++] = dst[k];
+
+  for (int x = n; x > 0; x--)
+    r->start[x] = r->start[x - 1];
+
+  r->start[0] = 0;
+  return LL1_OK;
+}
+
+/* relation_free(): deallocate a relation.
+ */
+void relation_free (grammar_t* g, struct relation *r) {
+  mem_free(g, r->start);
+  mem_free(g, r->adj);
+}
+
+/* digraph(): compute, for each of @n nodes, the union @F[x] of its
+ * initial set and the sets of every node reachable from it through the
+ * relation @r. strongly connected components share one final set. the
+ * traversal keeps an explicit stack, so deep relations cannot overflow
+ * the call stack. every edge followed is a step of work on the symbol
+ * @sym[x] of its source node, if @sym is given.
+ */
+int digraph (grammar_t* g, int n, struct relation *r, bits_t *F, int w,
+             const int *sym) {
+  int *N = (int*) mem_alloc(g, MEM_TEMP, (n + 1) * sizeof(int));
+  int *D = (int*) mem_alloc(g, MEM_TEMP, (n + 1) * sizeof(int));
+  int *E = (int*) mem_alloc(g, MEM_TEMP, (n + 1) * sizeof(int));
+  int *stack = (int*) mem_alloc(g, MEM_TEMP, (n + 1) * sizeof(int));
+  int *path = (int*) mem_alloc(g, MEM_TEMP, (n + 1) * sizeof(int));
+
+  if (!g->status) {
+    int sp = 0;
+    memset(N, 0, n * sizeof(int));
+
+    for (int x0 = 0; x0 < n && !g->status; x0++) {
+      if (N[x0])
+        continue;
+
+      int depth = 0;
+      path[0] = x0;
+      stack[sp++] = x0;
+      N[x0] = D[x0] = sp;
+      E[x0] = r->start[x0];
+
+      while (depth >= 0) {
+        int x = path[depth];
+
+        if (E[x] < r->start[x + 1]) {
+          int y = r->adj[E[x]++];
+
+          if (work_step(g, sym ? sym[x] : 0))
+            break;
+
+          if (N[y] == 0) {
+            path[++depth] = y;
+            stack[sp++] = y;
+            N[y] = D[y] = sp;
+            E[y] = r->start[y];
+          }
+          else {
+            if (N[y] < N[x])
+              N[x] = N[y];
+
+            bits_union(F + x * w, F + y * w, w);
+          }
+
+          continue;
+        }
+
+        if (N[x] == D[x]) {
+          int top;
+
+          do {
+            top = stack[--sp];
+            N[top] = INT_MAX;
+            if (top != x)
+              bits_copy(F + top * w, F + x * w, w);
+          }
+          while (top != x);
+        }
+
+        if (--depth >= 0) {
+          int u = path[depth];
+
+          if (N[x] < N[u])
+            N[u] = N[x];
+
+          bits_union(F + u * w, F + x * w, w);
+        }
+      }
+    }
+  }
+
+  mem_free(g, N);
+  mem_free(g, D);
+  mem_free(g, E);
+  mem_free(g, stack);
+  mem_free(g, path);
+
+  return g->status;
+}
+
+/* sets_alloc(): allocate @n empty sets of @w words each.
+ */
+bits_t *sets_alloc (grammar_t* g, int n, int w) {
+  bits_t *F = (bits_t*) mem_alloc(g, MEM_TEMP, (n * w + 1) * sizeof(bits_t));
+
+  if (F)
+    bits_zero(F, n * w);
+
+  return F;
+}
+
+/* sets_pack(): fill the set @b of terminals from the symbol array @sv.
+ */
+void sets_pack (grammar_t* g, bits_t *b, const int *sv) {
+  for (; sv && *sv; sv++) {
+    if (bits_test(g->sym_terminal, *sv - 1))
+      bits_set(b, g->dense[*sv - 1]);
+  }
+}
+
+/* sets_unpack(): get the interned symbol array, in memory class @cls, of
+ * all terminals in the @w-word set @b. returns NULL if the set is empty.
+ */
+int *sets_unpack (grammar_t* g, int cls, const bits_t *b, int w) {
+  int n = bits_count(b, w);
+
+  if (n == 0 || g->status)
+    return NULL;
+
+  int *sv = (int*) mem_alloc(g, cls, (n + 1) * sizeof(int));
+  if (!sv)
+    return NULL;
+
+  n = 0;
+  for (int i = bits_next(b, w, 0); i >= 0; i = bits_next(b, w, i + 1))
+    sv[n++] = g->terms[i];
+
+  sv[n] = 0;
+  return symv_intern(g, cls, sv);
+}
+
+/* suffixes_alloc(): allocate the first sets and nullability of every
+ * right-hand side suffix, replacing any computed before. only the empty
+ * suffix at the terminator of each production is filled in.
+ */
+int suffixes_alloc (grammar_t* g) {
+  mem_free(g, g->suffix_first);
+  mem_free(g, g->suffix_empty);
+
+  g->suffix_first = (int**)
+    mem_alloc(g, MEM_FIRST, (g->n_rhs + 1) * sizeof(int*));
+  g->suffix_empty = (bits_t*)
+    mem_alloc(g, MEM_FIRST, (bits_words(g->n_rhs) + 1) * sizeof(bits_t));
+
+  if (g->status)
+    return g->status;
+
+  memset(g->suffix_first, 0, (g->n_rhs + 1) * sizeof(int*));
+  bits_zero(g->suffix_empty, bits_words(g->n_rhs));
+
+  for (int i = 0; i < g->n_prods; i++)
+    bits_set(g->suffix_empty, g->prod_off[i] + g->prod_len[i]);
+
+  return LL1_OK;
+}
+
+/* rhs_total(): get the total number of right-hand side symbols, which
+ * is the size of the shared right-hand side store less one terminator
+ * per production.
+ */
+static int rhs_total (grammar_t* g) {
+  return g->n_rhs - g->n_prods;
+}
+
+/* epsilon_index(): get the dense index of the epsilon terminal, or -1 if
+ * the grammar does not use it.
+ */
+int epsilon_index (grammar_t* g) {
+  for (int t = 0; t < g->n_terms; t++) {
+    if (symbol_is_empty(g, g->terms[t]))
+      return t;
+  }
+
+  return -1;
+}
+
+/* engine_derives_empty_prod(): mark production @i as deriving epsilon
+ * once its @yield drops to zero, queueing its left-hand side on @work.
+ */
+static void engine_derives_empty_prod (grammar_t* g, int i,
+                                       int *work, int *n_work) {
+  int lhs = g->prod_lhs[i] - 1;
+
+  if (g->prod_yield[i])
+    return;
+
+  bits_set(g->prod_empty, i);
+
+  if (!bits_test(g->sym_empty, lhs)) {
+    bits_set(g->sym_empty, lhs);
+    work[(*n_work)++] = g->dense[lhs];
+  }
+}
+
+/* engine_derives_empty(): determine which symbols and productions derive
+ * epsilon, visiting each right-hand side occurrence of a nonterminal at
+ * most once through a nonterminal-to-production occurrence relation.
+ */
+int engine_derives_empty (grammar_t* g) {
+  struct relation occ = { NULL, NULL };
+  int i, j, m = rhs_total(g), n_work = 0;
+
+  int *src = (int*) mem_alloc(g, MEM_TEMP, (m + 1) * sizeof(int));
+  int *dst = (int*) mem_alloc(g, MEM_TEMP, (m + 1) * sizeof(int));
+  int *work = (int*) mem_alloc(g, MEM_TEMP, (g->n_nonterms + 1) * sizeof(int));
+
+  if (!g->status) {
+    int eps = epsilon_index(g);
+
+    bits_zero(g->sym_empty, bits_words(g->n_symbols));
+    bits_zero(g->prod_empty, bits_words(g->n_prods));
+    memset(g->prod_yield, 0, g->n_prods * sizeof(int));
+
+    if (eps >= 0)
+      bits_set(g->sym_empty, g->terms[eps] - 1);
+
+    for (i = 0, m = 0; i < g->n_prods; i++) {
+      int *rhs = g->rhs + g->prod_off[i];
+
+      for (j = 0; j < g->prod_len[i]; j++) {
+        if (symbol_is_empty(g, rhs[j]))
+          continue;
+
+        g->prod_yield[i]++;
+
+        if (!bits_test(g->sym_terminal, rhs[j] - 1)) {
+          src[m] = g->dense[rhs[j] - 1];
+          dst[m++] = i;
+        }
+      }
+    }
+  }
+
+  if (!g->status && !relation_build(g, &occ, g->n_nonterms, m, src, dst)) {
+    for (i = 0; i < g->n_prods; i++)
+      engine_derives_empty_prod(g, i, work, &n_work);
+
+    while (n_work) {
+      int k = work[--n_work];
+
+      if (work_step(g, g->nonterms[k]))
+        break;
+
+      for (j = occ.start[k]; j < occ.start[k + 1]; j++) {
+        g->prod_yield[occ.adj[j]]--;
+        engine_derives_empty_prod(g, occ.adj[j], work, &n_work);
+      }
+    }
+  }
+
+  relation_free(g, &occ);
+  mem_free(g, src);
+  mem_free(g, dst);
+  mem_free(g, work);
+
+  return g->status;
+}
+
+/* engine_first_suffixes(): compute the first set and nullability of
+ * every right-hand side suffix from the first sets @F of the
+ * nonterminals, in one right-to-left pass over each production. a
+ * suffix shares the first set of its leading symbol, unless that is a
+ * nonterminal deriving epsilon, which is the only case that needs the
+ * set @S of the suffix after it.
+ */
+static int engine_first_suffixes (grammar_t* g, const bits_t *F, int w) {
+  bits_t *S = sets_alloc(g, 1, w);
+
+  if (!suffixes_alloc(g)) {
+    for (int i = 0; i < g->n_prods && !work_step(g, g->prod_lhs[i]); i++) {
+      bool packed = false;
+
+      for (int k = g->prod_off[i] + g->prod_len[i] - 1;
+           k >= g->prod_off[i]; k--) {
+        int s = g->rhs[k] - 1, d = g->dense[s];
+        bool empty = bits_test(g->sym_empty, s);
+
+        bits_put(g->suffix_empty, k, empty &&
+                                     bits_test(g->suffix_empty, k + 1));
+
+        if (bits_test(g->sym_terminal, s) || !empty) {
+          g->suffix_first[k] = g->symbols[s].first;
+          packed = false;
+          continue;
+        }
+
+        if (!packed) {
+          bits_zero(S, w);
+          sets_pack(g, S, g->suffix_first[k + 1]);
+          packed = true;
+        }
+
+        g->suffix_first[k] = bits_union(S, F + d * w, w)
+                           ? sets_unpack(g, MEM_FIRST, S, w)
+                           : g->suffix_first[k + 1];
+      }
+    }
+  }
+
+  mem_free(g, S);
+  return g->status;
+}
+
+/* engine_first(): compute the @first sets of all symbols. a nonterminal
+ * directly begins with the terminals and nonterminals found in each of
+ * its right-hand sides up to the first symbol that is a terminal or does
+ * not derive epsilon. sets hold terminals only, and are solved over the
+ * nonterminals alone. the first sets of all right-hand side suffixes
+ * follow from them.
+ */
+int engine_first (grammar_t* g) {
+  struct relation r = { NULL, NULL };
+  int n = g->n_nonterms, w = bits_words(g->n_terms), m = rhs_total(g);
+  int k = 0;
+
+  bits_t *F = sets_alloc(g, n, w);
+  bits_t *T = sets_alloc(g, 1, w);
+  int *src = (int*) mem_alloc(g, MEM_TEMP, (m + 1) * sizeof(int));
+  int *dst = (int*) mem_alloc(g, MEM_TEMP, (m + 1) * sizeof(int));
+
+  for (int i = 0; i < g->n_prods && !g->status; i++) {
+    int lhs = g->dense[g->prod_lhs[i] - 1];
+    int *rhs = g->rhs + g->prod_off[i], len = g->prod_len[i];
+
+    if (work_step(g, g->prod_lhs[i]))
+      break;
+
+    for (int j = 0; j < len; j++) {
+      int s = rhs[j] - 1;
+
+      if (bits_test(g->sym_terminal, s)) {
+        bits_set(F + lhs * w, g->dense[s]);
+        break;
+      }
+
+      src[k] = lhs;
+      dst[k++] = g->dense[s];
+
+      if (!bits_test(g->sym_empty, s))
+        break;
+    }
+  }
+
+  if (!g->status && !relation_build(g, &r, n, k, src, dst) &&
+      !digraph(g, n, &r, F, w, g->nonterms)) {
+    for (int i = 0; i < g->n_symbols; i++) {
+      int d = g->dense[i];
+
+      if (bits_test(g->sym_terminal, i)) {
+        bits_zero(T, w);
+        bits_set(T, d);
+        g->symbols[i].first = sets_unpack(g, MEM_FIRST, T, w);
+      }
+      else
+        g->symbols[i].first = sets_unpack(g, MEM_FIRST, F + d * w, w);
+    }
+
+    engine_first_suffixes(g, F, w);
+  }
+
+  relation_free(g, &r);
+  mem_free(g, F);
+  mem_free(g, T);
+  mem_free(g, src);
+  mem_free(g, dst);
+
+  return g->status;
+}
+
+/* engine_follow(): compute the @follow sets of all nonterminals. each
+ * occurrence of a nonterminal directly contributes the first set of the
+ * suffix after it, and relates it to the left-hand side when that suffix
+ * derives epsilon.
+ */
+int engine_follow (grammar_t* g) {
+  struct relation r = { NULL, NULL };
+  int n = g->n_nonterms, w = bits_words(g->n_terms), m = rhs_total(g);
+  int k = 0, eps = epsilon_index(g);
+
+  bits_t *F = sets_alloc(g, n, w);
+  int *src = (int*) mem_alloc(g, MEM_TEMP, (m + 1) * sizeof(int));
+  int *dst = (int*) mem_alloc(g, MEM_TEMP, (m + 1) * sizeof(int));
+
+  for (int i = 0; i < g->n_prods && !g->status; i++) {
+    int lhs = g->dense[g->prod_lhs[i] - 1];
+    int *rhs = g->rhs + g->prod_off[i], len = g->prod_len[i];
+
+    if (work_step(g, g->prod_lhs[i]))
+      break;
+
+    for (int j = 0; j < len; j++) {
+      int s = rhs[j] - 1, d = g->dense[s], next = g->prod_off[i] + j + 1;
+
+      if (bits_test(g->sym_terminal, s))
+        continue;
+
+      /* a terminal next is the whole first set of the suffix. */
+      if (j + 1 < len && bits_test(g->sym_terminal, rhs[j + 1] - 1))
+        bits_set(F + d * w, g->dense[rhs[j + 1] - 1]);
+      else
+        sets_pack(g, F + d * w, g->suffix_first[next]);
+
+      if (bits_test(g->suffix_empty, next)) {
+        src[k] = d;
+        dst[k++] = lhs;
+      }
+    }
+  }
+
+  if (!g->status && !relation_build(g, &r, n, k, src, dst) &&
+      !digraph(g, n, &r, F, w, g->nonterms)) {
+    for (int i = 0; i < n; i++) {
+      if (eps >= 0)
+        bits_clear(F + i * w, eps);
+
+      g->symbols[g->nonterms[i] - 1].follow =
+        sets_unpack(g, MEM_FOLLOW, F + i * w, w);
+    }
+  }
+
+  relation_free(g, &r);
+  mem_free(g, F);
+  mem_free(g, src);
+  mem_free(g, dst);
+
+  return g->status;
+}
+
+/* engine_predict(): compute the @predict sets of all productions from the
+ * first set of each right-hand side and, for productions deriving
+ * epsilon, the follow set of the left-hand side.
+ */
+int engine_predict (grammar_t* g) {
+  int n = g->n_nonterms, w = bits_words(g->n_terms);
+  int eps = epsilon_index(g);
+
+  bits_t *P = sets_alloc(g, 1, w);
+  bits_t *FO = sets_alloc(g, n, w);
+
+  for (int i = 0; i < n && !g->status; i++)
+    sets_pack(g, FO + i * w, g->symbols[g->nonterms[i] - 1].follow);
+
+  for (int i = 0; i < g->n_prods && !g->status; i++) {
+    int lhs = g->dense[g->prod_lhs[i] - 1];
+
+    if (work_step(g, g->prod_lhs[i]))
+      break;
+
+    bits_zero(P, w);
+    sets_pack(g, P, g->suffix_first[g->prod_off[i]]);
+
+    if (bits_test(g->prod_empty, i))
+      bits_union(P, FO + lhs * w, w);
+
+    if (eps >= 0)
+      bits_clear(P, eps);
+
+    g->prods[i].predict = sets_unpack(g, MEM_PREDICT, P, w);
+  }
+
+  mem_free(g, P);
+  mem_free(g, FO);
+
+  return g->status;
+}
@@ -0,0 +1,36 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "grammar.h"
+
+/* data structure for holding a relation between symbols in compressed
+ * sparse row form: the symbols related to @x are @adj[@start[x]] up to
+ * @adj[@start[x + 1] - 1].
+ */
+struct relation {
+  int *start, *adj;
+};
+
+/* pre-declare relation functions, shared by the analysis passes. */
+int relation_build (grammar_t* g, struct relation *r, int n, int m,
+                    const int *src, const int *dst);
+void relation_free (grammar_t* g, struct relation *r);
+int digraph (grammar_t* g, int n, struct relation *r, bits_t *F, int w,
+             const int *sym);
+
+/* pre-declare terminal set functions, shared by the analysis passes. */
+bits_t *sets_alloc (grammar_t* g, int n, int w);
+void sets_pack (grammar_t* g, bits_t *b, const int *sv);
+int *sets_unpack (grammar_t* g, int cls, const bits_t *b, int w);
+int epsilon_index (grammar_t* g);
+int suffixes_alloc (grammar_t* g);
+
+/* pre-declare functions of the optimized analysis engine. each computes
+ * exactly the same results as its reference counterpart in grammar.c.
+ */
+int engine_derives_empty (grammar_t* g);
+int engine_first (grammar_t* g);
+int engine_follow (grammar_t* g);
+int engine_predict (grammar_t* g);
+
+#endif
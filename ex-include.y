@@ -0,0 +1,21 @@
+/* expression grammar using the operator tokens of another module. */
+
+%include "ex-tokens.inc"
+
+%%
+
+expr : term expr_next ;
+
+expr_next : "+" expr
+          | "-" expr
+          | %empty
+          ;
+
+term : factor term_next ;
+
+term_next : "*" term
+          | "/" term
+          | %empty
+          ;
+
+factor : ID | NUM ;
@@ -1,27 +1,405 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include "grammar.h"
-#include "main.h"
+#include "engine.h"
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+/* data structure prefixed to every accounted allocation, recording the
+ * @size and @cls of the block that follows it.
+ */
+union mem_header {
+  struct {
+    size_t size;
+    int cls;
+  } h;
+
+  max_align_t align;
+};
+
+/* names of the memory classes and processing phases. */
+static const char *mem_class_names[MEM_N_CLASSES] = {
+  "symbols", "productions", "first", "follow", "predict", "automaton",
+  "temporaries"
+};
+
+static const char *phase_names[PHASE_N_PHASES] = {
+  "setup", "parse", "load", "prune", "empty", "first", "follow", "predict",
+  "conflicts", "lr"
+};
+
+/* grammar_init(): initialize an empty grammar. every grammar object is
+ * self-contained, so any number of them may be used concurrently.
+ */
+void grammar_init (grammar_t* g) {
+  g->status = LL1_OK;
+  g->errmsg[0] = '\0';
+
+  g->phase = PHASE_NONE;
+  memset(&g->mem, 0, sizeof(g->mem));
+  memset(&g->work, 0, sizeof(g->work));
+  memset(g->sets, 0, sizeof(g->sets));
+
+  g->engine = ENGINE_OPTIMIZED;
+  g->threads = 0;
+  g->cache_dir = NULL;
+
+  symbols_init(g);
+  prods_init(g);
+  aliases_init(g);
+  includes_init(g);
+}
+
+/* grammar_free(): deallocate all tables held by a grammar.
+ */
+void grammar_free (grammar_t* g) {
+  aliases_free(g);
+  includes_free(g);
+  symbols_free(g);
+  prods_free(g);
+  symv_store_free(g);
+}
+
+/* grammar_fail(): record a failure having @status and a printf-style
+ * message in the grammar. only the first failure is kept, and its status
+ * is returned.
+ */
+int grammar_fail (grammar_t* g, int status, const char *fmt, ...) {
+  va_list vl;
+
+  if (g->status)
+    return g->status;
+
+  g->status = status;
+
+  va_start(vl, fmt);
+  vsnprintf(g->errmsg, LL1_ERRMSG_MAX, fmt, vl);
+  va_end(vl);
+
+  return status;
+}
+
+/* grammar_error(): get the message of the first recorded failure.
+ */
+const char *grammar_error (grammar_t* g) {
+  return (g->status ? g->errmsg : ll1_strerror(LL1_OK));
+}
+
+/* ll1_strerror(): get a short description of a status code.
+ */
+const char *ll1_strerror (int status) {
+  switch (status) {
+    case LL1_OK:      return "success";
+    case LL1_ENOMEM:  return "out of memory";
+    case LL1_EIO:     return "input/output error";
+    case LL1_EPARSE:  return "parse failed";
+    case LL1_EFORMAT: return "malformed compiled grammar";
+    case LL1_EBUDGET: return "memory budget exceeded";
+    case LL1_ELIMIT:  return "time or step limit exceeded";
+  }
+
+  return "unknown error";
+}
+
+/* grammar_phase(): enter the processing @phase. the peak memory use of
+ * the phase starts out at the current total, and no nonterminal is yet
+ * being worked on.
+ */
+void grammar_phase (grammar_t* g, int phase) {
+  g->phase = phase;
+  g->work.current = 0;
+
+  if (g->mem.phase_peak[phase] < g->mem.total)
+    g->mem.phase_peak[phase] = g->mem.total;
+}
+
+/* phase_name(): get the name of a processing phase.
+ */
+const char *phase_name (int phase) {
+  if (phase < 0 || phase >= PHASE_N_PHASES)
+    return "unknown";
+
+  return phase_names[phase];
+}
+
+/* mem_account(): add @n bytes to (or, for negative @n, remove them from)
+ * the memory class @cls, updating all peaks.
+ */
+static void mem_account (grammar_t* g, int cls, ptrdiff_t n) {
+  struct mem_stats *m = &g->mem;
+
+  m->cur[cls] += n;
+  m->total += n;
+
+  if (m->cur[cls] > m->peak[cls])
+    m->peak[cls] = m->cur[cls];
+
+  if (m->total > m->peak_total)
+    m->peak_total = m->total;
+
+  if (m->total > m->phase_peak[g->phase])
+    m->phase_peak[g->phase] = m->total;
+
+  for (struct mem_shared *s = m->shared; s; s = s->up) {
+    size_t total = atomic_fetch_add(&s->total, (size_t) n) + (size_t) n;
+    size_t peak = atomic_load(&s->peak);
+
+    while (total > peak &&
+           !atomic_compare_exchange_weak(&s->peak, &peak, total));
+  }
+}
+
+/* mem_total(): get the total bytes that the memory budget of @g applies
+ * to: those of the outermost shared use, if any, or else its own.
+ */
+static size_t mem_total (grammar_t* g) {
+  struct mem_shared *s = g->mem.shared;
+
+  if (!s)
+    return g->mem.total;
+
+  while (s->up)
+    s = s->up;
+
+  return atomic_load(&s->total);
+}
+
+/* mem_alloc(): allocate @n bytes in the memory class @cls. on failure,
+ * or if the allocation would exceed the memory budget, the failure is
+ * recorded in the grammar and NULL is returned.
+ */
+void *mem_alloc (grammar_t* g, int cls, size_t n) {
+  return mem_realloc(g, cls, NULL, n);
+}
+
+/* mem_realloc(): resize the block @p (or allocate a new block, if @p is
+ * NULL) to @n bytes in the memory class @cls. on failure, the failure is
+ * recorded in the grammar, @p is left untouched and NULL is returned.
+ */
+void *mem_realloc (grammar_t* g, int cls, void *p, size_t n) {
+  union mem_header *hdr = (p ? (union mem_header*) p - 1 : NULL);
+  size_t old = (hdr ? hdr->h.size : 0);
+
+  if (g->mem.limit && n > old &&
+      mem_total(g) + (n - old) > g->mem.limit) {
+    grammar_fail(g, LL1_EBUDGET,
+                 "memory budget of %zu bytes exceeded during %s phase "
+                 "(%zu bytes of %s requested)", g->mem.limit,
+                 phase_name(g->phase), n - old, mem_class_names[cls]);
+    return NULL;
+  }
+
+  union mem_header *hnew = realloc(hdr, sizeof(union mem_header) + n);
+  if (!hnew) {
+    grammar_fail(g, LL1_ENOMEM, "unable to allocate %zu bytes of %s "
+                 "during %s phase", n, mem_class_names[cls],
+                 phase_name(g->phase));
+    return NULL;
+  }
+
+  if (hdr)
+    mem_account(g, hnew->h.cls, -(ptrdiff_t) old);
+
+  hnew->h.size = n;
+  hnew->h.cls = cls;
+  mem_account(g, cls, n);
+
+  return hnew + 1;
+}
+
+/* mem_strdup(): duplicate the string @s in the memory class @cls.
+ */
+char *mem_strdup (grammar_t* g, int cls, const char *s) {
+  size_t n = strlen(s) + 1;
+  char *dup = (char*) mem_alloc(g, cls, n);
+
+  if (dup)
+    memcpy(dup, s, n);
+
+  return dup;
+}
+
+/* mem_reclass(): move the block @p into the memory class @cls, as when
+ * a temporary becomes part of the analysis results.
+ */
+void mem_reclass (grammar_t* g, void *p, int cls) {
+  if (!p)
+    return;
+
+  union mem_header *hdr = (union mem_header*) p - 1;
+
+  mem_account(g, hdr->h.cls, -(ptrdiff_t) hdr->h.size);
+  hdr->h.cls = cls;
+  mem_account(g, cls, hdr->h.size);
+}
+
+/* mem_free(): deallocate the block @p.
+ */
+void mem_free (grammar_t* g, void *p) {
+  if (!p)
+    return;
+
+  union mem_header *hdr = (union mem_header*) p - 1;
+
+  mem_account(g, hdr->h.cls, -(ptrdiff_t) hdr->h.size);
+  free(hdr);
+}
+
+/* mem_set_limit(): limit the total bytes allocated by the grammar, or
+ * remove the limit if @limit is zero.
+ */
+void mem_set_limit (grammar_t* g, size_t limit) {
+  g->mem.limit = limit;
+}
+
+/* mem_share_begin(): start charging the allocations of @g, and of any
+ * grammar given the same shared use, to @s as well. @s starts from the
+ * current use of @g.
+ */
+void mem_share_begin (grammar_t* g, struct mem_shared *s) {
+  atomic_init(&s->total, g->mem.total);
+  atomic_init(&s->peak, g->mem.total);
+  s->up = g->mem.shared;
+
+  g->mem.shared = s;
+}
+
+/* mem_share_end(): stop charging the allocations of @g to its current
+ * shared use, once every other grammar charged to it has been freed,
+ * and count the peak of the shared use in the peaks of @g.
+ */
+void mem_share_end (grammar_t* g) {
+  struct mem_shared *s = g->mem.shared;
+  size_t peak = atomic_load(&s->peak);
+
+  if (peak > g->mem.peak_total)
+    g->mem.peak_total = peak;
+
+  if (peak > g->mem.phase_peak[g->phase])
+    g->mem.phase_peak[g->phase] = peak;
+
+  g->mem.shared = s->up;
+}
+
+/* mem_print(): print the current and peak memory use of each class, and
+ * the peak memory use of each phase.
+ */
+void mem_print (grammar_t* g) {
+  int i;
+
+  for (i = 0; i < MEM_N_CLASSES; i++)
+    printf("  %-12s %12zu bytes, peak %12zu bytes\n", mem_class_names[i],
+           g->mem.cur[i], g->mem.peak[i]);
+
+  printf("  %-12s %12zu bytes, peak %12zu bytes\n\n", "total",
+         g->mem.total, g->mem.peak_total);
+
+  for (i = PHASE_PARSE; i < PHASE_N_PHASES; i++) {
+    if (g->mem.phase_peak[i])
+      printf("  %-12s peak %12zu bytes\n", phase_names[i],
+             g->mem.phase_peak[i]);
+  }
+
+  printf("\n");
+}
+
+/* work_now(): get a monotonic timestamp in seconds.
+ */
+static double work_now (void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* work_set_timeout(): limit the time spent on the grammar from now on to
+ * @seconds, or remove the limit if @seconds is zero.
+ */
+void work_set_timeout (grammar_t* g, double seconds) {
+  g->work.timeout = seconds;
+  g->work.start = work_now();
+}
+
+/* work_set_budget(): limit the steps taken in the @phase, or in every
+ * phase if @phase is PHASE_NONE, to @steps. a budget of zero steps
+ * removes the limit.
+ */
+void work_set_budget (grammar_t* g, int phase, long steps) {
+  for (int i = 0; i < PHASE_N_PHASES; i++) {
+    if (phase == PHASE_NONE || phase == i)
+      g->work.budget[i] = steps;
+  }
+}
+
+/* work_step(): take one step of the current phase, working on the
+ * nonterminal @sym (or, if zero, on the same as before). once the step
+ * budget of the phase or the time limit is exceeded, the failure is
+ * recorded in the grammar. the clock is only read every 1024 steps.
+ */
+int work_step (grammar_t* g, int sym) {
+  struct work_stats *w = &g->work;
+  long n = ++w->steps[g->phase], budget = w->budget[g->phase];
+  char limit[64];
+
+  if (sym)
+    w->current = sym;
+
+  if (g->status)
+    return g->status;
+
+  if (budget && n > budget)
+    snprintf(limit, sizeof(limit), "step budget of %ld", budget);
+  else if (w->timeout && n % 1024 == 0 &&
+           work_now() - w->start > w->timeout)
+    snprintf(limit, sizeof(limit), "time limit of %gs", w->timeout);
+  else
+    return LL1_OK;
+
+  if (w->current)
+    return grammar_fail(g, LL1_ELIMIT, "%s exceeded during %s phase, "
+                        "at nonterminal %s", limit, phase_name(g->phase),
+                        g->symbols[w->current - 1].name);
+
+  return grammar_fail(g, LL1_ELIMIT, "%s exceeded during %s phase", limit,
+                      phase_name(g->phase));
+}
 
 void aliases_init(grammar_t* g) {
-  g->aliases = malloc(sizeof(struct alias)*1);
+  g->aliases = NULL;
   g->alias_count = 0;
 }
 
 void aliases_free(grammar_t* g) {
-  free(g->aliases);
+  for (int i = 0; i < g->alias_count; i++) {
+    mem_free(g, g->aliases[i].from);
+    mem_free(g, g->aliases[i].to);
+  }
+
+  mem_free(g, g->aliases);
 }
 
-void aliases_add(grammar_t* g, char* symbol, char* alias) {
-  g->aliases = realloc(g->aliases, sizeof(struct alias)*(g->alias_count+1));
+int aliases_add(grammar_t* g, char* symbol, char* alias) {
+  struct alias *aliases =
+    mem_realloc(g, MEM_SYMBOLS, g->aliases,
+                sizeof(struct alias)*(g->alias_count+1));
+
+  if (!aliases) {
+    mem_free(g, symbol);
+    mem_free(g, alias);
+    return g->status;
+  }
+
+  g->aliases = aliases;
   g->aliases[g->alias_count].from = symbol;
   g->aliases[g->alias_count].to = alias;
   g->alias_count++;
+
+  return LL1_OK;
 }
 
 /* aliased_from(): returns a reference pointer to the string name was aliased to.
@@ -29,12 +407,54 @@ void aliases_add(grammar_t* g, char* symbol, char* alias) {
  */
 char* aliased_from(grammar_t* g, char* name) {
   for (int i = 0; i < g->alias_count; i++) {
-    if (strcmp(g->aliases[i].to, name) == 0)
-      return strdup(g->aliases[i].from);
+    if (strcmp(g->aliases[i].to, name) == 0) {
+      char *from = mem_strdup(g, MEM_SYMBOLS, g->aliases[i].from);
+      if (!from)
+        return name;
+
+      mem_free(g, name);
+      return from;
+    }
   }
   return name;
 }
 
+/* includes_init(): initialize the include list of the grammar.
+ */
+void includes_init (grammar_t* g) {
+  g->includes = NULL;
+  g->n_includes = 0;
+}
+
+/* includes_free(): deallocate the include list of the grammar.
+ */
+void includes_free (grammar_t* g) {
+  for (int i = 0; i < g->n_includes; i++)
+    mem_free(g, g->includes[i]);
+
+  mem_free(g, g->includes);
+}
+
+/* includes_add(): append the module @name, requested by an include
+ * directive, to the include list of the grammar. the list takes over
+ * the name, which is freed on failure.
+ */
+int includes_add (grammar_t* g, char *name) {
+  char **includes = (char**)
+    mem_realloc(g, MEM_SYMBOLS, g->includes,
+                (g->n_includes + 1) * sizeof(char*));
+
+  if (!includes) {
+    mem_free(g, name);
+    return g->status;
+  }
+
+  g->includes = includes;
+  g->includes[g->n_includes++] = name;
+
+  return LL1_OK;
+}
+
 /* symbol_is_empty(): return whether a symbol (specified by the one-based
  * index @sym) is the epsilon terminal.
  */
@@ -48,22 +468,65 @@ int symbol_is_empty (grammar_t* g, int sym) {
 void symbols_init (grammar_t* g) {
   g->symbols = NULL;
   g->n_symbols = 0;
+
+  g->sym_terminal = g->sym_empty = g->sym_visited = NULL;
+
+  g->terms = g->nonterms = g->dense = NULL;
+  g->n_terms = g->n_nonterms = 0;
 }
 
 /* symbols_free(): deallocate the global symbol table.
  */
 void symbols_free (grammar_t* g) {
-  for (int i = 0; i < g->n_symbols; i++) {
-    free(g->symbols[i].name);
+  for (int i = 0; i < g->n_symbols; i++)
+    mem_free(g, g->symbols[i].name);
+
+  mem_free(g, g->symbols);
+  mem_free(g, g->sym_terminal);
+  mem_free(g, g->sym_empty);
+  mem_free(g, g->sym_visited);
+  mem_free(g, g->terms);
+  mem_free(g, g->nonterms);
+  mem_free(g, g->dense);
+}
 
-    if (g->symbols[i].first)
-      free(g->symbols[i].first);
+/* bits_resize(): resize the bitmap @b, in memory class @cls, from @n_old
+ * to @n elements. elements beyond @n_old start out cleared.
+ */
+static int bits_resize (grammar_t* g, int cls, bits_t **b, int n_old, int n) {
+  int w_old = bits_words(n_old), w = bits_words(n);
 
-    if (g->symbols[i].follow)
-      free(g->symbols[i].follow);
-  }
+  if (*b && w == w_old)
+    return LL1_OK;
+
+  bits_t *bnew = (bits_t*) mem_realloc(g, cls, *b, (w + 1) * sizeof(bits_t));
+  if (!bnew)
+    return g->status;
+
+  if (w > w_old)
+    bits_zero(bnew + w_old, w - w_old);
+
+  *b = bnew;
+  return LL1_OK;
+}
 
-  free(g->symbols);
+/* symbols_resize(): resize the symbol table and the symbol flags to hold
+ * @n symbols. the count of symbols is left to the caller.
+ */
+int symbols_resize (grammar_t* g, int n) {
+  struct symbol *symbols = (struct symbol*)
+    mem_realloc(g, MEM_SYMBOLS, g->symbols, (n + 1) * sizeof(struct symbol));
+
+  if (!symbols)
+    return g->status;
+
+  g->symbols = symbols;
+
+  bits_resize(g, MEM_SYMBOLS, &g->sym_terminal, g->n_symbols, n);
+  bits_resize(g, MEM_SYMBOLS, &g->sym_empty, g->n_symbols, n);
+  bits_resize(g, MEM_SYMBOLS, &g->sym_visited, g->n_symbols, n);
+
+  return g->status;
 }
 
 /* symbols_find(): get the one-based index of a symbol (by @name) in the
@@ -83,40 +546,75 @@ int symbols_find (grammar_t* g, char *name) {
 /* symbols_add(): ensure that a symbol having @name and @is_terminal
  * flag exists in the symbol table. if the symbol @name exists, its
  * @is_terminal flag is updated based on the passed value. the
- * one-based symbol table index is returned.
+ * one-based symbol table index is returned, or zero on failure.
  */
 int symbols_add (grammar_t* g, char *name, int is_terminal) {
   int sym = symbols_find(g, name);
   if (sym) {
-    g->symbols[sym - 1].is_terminal &= is_terminal;
+    if (!is_terminal)
+      bits_clear(g->sym_terminal, sym - 1);
 
-    free(name);
+    mem_free(g, name);
     return sym;
   }
 
-  g->symbols = (struct symbol*)
-    realloc(g->symbols, ++g->n_symbols * sizeof(struct symbol));
+  if (symbols_resize(g, g->n_symbols + 1)) {
+    mem_free(g, name);
+    return 0;
+  }
 
-  if (!g->symbols)
-    derp("unable to resize symbol table");
+  g->n_symbols++;
 
-  g->symbols[g->n_symbols - 1].name = strdup(name);
-  g->symbols[g->n_symbols - 1].is_terminal = is_terminal;
-  g->symbols[g->n_symbols - 1].derives_empty = 0;
-  g->symbols[g->n_symbols - 1].visited = 0;
+  g->symbols[g->n_symbols - 1].name = name;
+  bits_put(g->sym_terminal, g->n_symbols - 1, is_terminal);
+  bits_clear(g->sym_empty, g->n_symbols - 1);
+  bits_clear(g->sym_visited, g->n_symbols - 1);
   g->symbols[g->n_symbols - 1].first = NULL;
   g->symbols[g->n_symbols - 1].follow = NULL;
 
-  free(name);
   return g->n_symbols;
 }
 
+/* symbols_number(): number the terminals and the nonterminals of the
+ * grammar separately, each densely from zero in symbol order. as the
+ * kind of a symbol is only settled once the whole grammar has been read,
+ * this is done when the analysis begins.
+ */
+int symbols_number (grammar_t* g) {
+  int n = g->n_symbols;
+
+  mem_free(g, g->terms);
+  mem_free(g, g->nonterms);
+  mem_free(g, g->dense);
+
+  g->terms = (int*) mem_alloc(g, MEM_SYMBOLS, (n + 1) * sizeof(int));
+  g->nonterms = (int*) mem_alloc(g, MEM_SYMBOLS, (n + 1) * sizeof(int));
+  g->dense = (int*) mem_alloc(g, MEM_SYMBOLS, (n + 1) * sizeof(int));
+  g->n_terms = g->n_nonterms = 0;
+
+  if (g->status)
+    return g->status;
+
+  for (int i = 0; i < n; i++) {
+    if (bits_test(g->sym_terminal, i)) {
+      g->dense[i] = g->n_terms;
+      g->terms[g->n_terms++] = i + 1;
+    }
+    else {
+      g->dense[i] = g->n_nonterms;
+      g->nonterms[g->n_nonterms++] = i + 1;
+    }
+  }
+
+  return LL1_OK;
+}
+
 /* symbols_print(): print all symbols in the table with @is_terminal
  * flag equaling a certain value.
  */
 void symbols_print (grammar_t* g, int is_terminal) {
   for (int i = 0; i < g->n_symbols; i++) {
-    if (g->symbols[i].is_terminal == is_terminal) {
+    if (bits_test(g->sym_terminal, i) == (is_terminal != 0)) {
       printf("  %s", g->symbols[i].name);
       for (int j = 0; j < g->alias_count; j++) {
         if (strcmp(g->aliases[j].from, g->symbols[i].name) == 0)
@@ -146,7 +644,7 @@ void symbols_print_empty (grammar_t* g) {
     if (symbol_is_empty(g, i + 1))
       continue;
 
-    if (g->symbols[i].derives_empty)
+    if (bits_test(g->sym_empty, i))
       printf(buf, g->symbols[i].name);
   }
 }
@@ -156,7 +654,7 @@ void symbols_print_empty (grammar_t* g) {
  */
 void symbols_print_first (grammar_t* g) {
   for (int i = 0; i < g->n_symbols; i++) {
-    if (g->symbols[i].is_terminal ||
+    if (bits_test(g->sym_terminal, i) ||
         symv_len(g->symbols[i].first) == 0)
       continue;
 
@@ -170,7 +668,7 @@ void symbols_print_first (grammar_t* g) {
  */
 void symbols_print_follow (grammar_t* g) {
   for (int i = 0; i < g->n_symbols; i++) {
-    if (g->symbols[i].is_terminal ||
+    if (bits_test(g->sym_terminal, i) ||
         symv_len(g->symbols[i].follow) == 0)
       continue;
 
@@ -179,12 +677,11 @@ void symbols_print_follow (grammar_t* g) {
   }
 }
 
-/* symbols_reset_visite(): reset the @visited flag of all symbols
+/* symbols_reset_visited(): reset the @sym_visited flags of all symbols
  * to zero. used internally by @first and @follow set construction.
  */
 void symbols_reset_visited (grammar_t* g) {
-  for (int i = 0; i < g->n_symbols; i++)
-    g->symbols[i].visited = 0;
+  bits_zero(g->sym_visited, bits_words(g->n_symbols));
 }
 
 /* prods_init(): initialize the global productions list.
@@ -192,46 +689,126 @@ void symbols_reset_visited (grammar_t* g) {
 void prods_init (grammar_t* g) {
   g->prods = NULL;
   g->n_prods = 0;
+
+  g->prod_lhs = g->prod_yield = NULL;
+  g->prod_empty = NULL;
+
+  g->rhs = NULL;
+  g->n_rhs = g->rhs_cap = 0;
+  g->prod_off = g->prod_len = NULL;
+
+  g->suffix_first = NULL;
+  g->suffix_empty = NULL;
 }
 
 /* prods_free(): deallocate the global productions list.
  */
 void prods_free (grammar_t* g) {
-  for (int i = 0; i < g->n_prods; i++) {
-    free(g->prods[i].rhs);
+  mem_free(g, g->prods);
+  mem_free(g, g->prod_lhs);
+  mem_free(g, g->prod_yield);
+  mem_free(g, g->prod_empty);
+  mem_free(g, g->rhs);
+  mem_free(g, g->prod_off);
+  mem_free(g, g->prod_len);
+  mem_free(g, g->suffix_first);
+  mem_free(g, g->suffix_empty);
+}
+
+/* prods_resize(): resize the production list and the production fields
+ * to hold @n productions. the count of productions is left to the
+ * caller.
+ */
+int prods_resize (grammar_t* g, int n) {
+  struct production *prods = (struct production*)
+    mem_realloc(g, MEM_PRODS, g->prods, (n + 1) * sizeof(struct production));
+  int *lhs = (int*)
+    mem_realloc(g, MEM_PRODS, g->prod_lhs, (n + 1) * sizeof(int));
+  int *yield = (int*)
+    mem_realloc(g, MEM_PRODS, g->prod_yield, (n + 1) * sizeof(int));
+  int *off = (int*)
+    mem_realloc(g, MEM_PRODS, g->prod_off, (n + 1) * sizeof(int));
+  int *len = (int*)
+    mem_realloc(g, MEM_PRODS, g->prod_len, (n + 1) * sizeof(int));
+
+  if (prods)
+    g->prods = prods;
 
-    if (g->prods[i].predict)
-      free(g->prods[i].predict);
+  if (lhs)
+    g->prod_lhs = lhs;
+
+  if (yield)
+    g->prod_yield = yield;
+
+  if (off)
+    g->prod_off = off;
+
+  if (len)
+    g->prod_len = len;
+
+  bits_resize(g, MEM_PRODS, &g->prod_empty, g->n_prods, n);
+
+  return g->status;
+}
+
+/* prods_append(): append a production with left-hand-side symbol index
+ * @lhs and room for @len right-hand-side symbols to the global
+ * productions list. the zero-terminated right-hand side is returned for
+ * the caller to fill in, or NULL on failure. it remains valid until the
+ * next production is appended.
+ */
+int *prods_append (grammar_t* g, int lhs, int len) {
+  if (g->n_rhs + len + 1 > g->rhs_cap) {
+    int cap = (g->rhs_cap ? 2 * g->rhs_cap : 64);
+    while (cap < g->n_rhs + len + 1)
+      cap *= 2;
+
+    int *rhs = (int*) mem_realloc(g, MEM_PRODS, g->rhs, cap * sizeof(int));
+    if (!rhs)
+      return NULL;
+
+    g->rhs = rhs;
+    g->rhs_cap = cap;
   }
 
-  free(g->prods);
+  if (prods_resize(g, g->n_prods + 1))
+    return NULL;
+
+  int i = g->n_prods++;
+
+  g->prod_lhs[i] = lhs;
+  g->prod_off[i] = g->n_rhs;
+  g->prod_len[i] = len;
+  g->prod_yield[i] = 0;
+  bits_clear(g->prod_empty, i);
+  g->prods[i].predict = NULL;
+
+  int *rhs = g->rhs + g->n_rhs;
+  memset(rhs, 0, (len + 1) * sizeof(int));
+  g->n_rhs += len + 1;
+
+  return rhs;
 }
 
 /* prods_add(): add a set of productions with left-hand-side symbol index
  * @lhs and right-hand-side symbol index arrays @rhsv to the global
- * productions list.
+ * productions list. the arrays are copied into the list and freed.
  */
-void prods_add (grammar_t* g, int lhs, int **rhsv) {
+int prods_add (grammar_t* g, int lhs, int **rhsv) {
   int n = symvv_len(rhsv);
 
   for (int i = 0; i < n; i++) {
-    int *rhs = rhsv[i];
-
-    g->prods = (struct production*)
-      realloc(g->prods, ++g->n_prods * sizeof(struct production));
+    int len = symv_len(rhsv[i]);
+    int *rhs = (g->status ? NULL : prods_append(g, lhs, len));
 
-    if (!g->prods)
-      derp("unable to resize production list");
+    if (rhs)
+      memcpy(rhs, rhsv[i], len * sizeof(int));
 
-    g->prods[g->n_prods - 1].lhs = lhs;
-    g->prods[g->n_prods - 1].rhs = rhs;
-
-    g->prods[g->n_prods - 1].yield = 0;
-    g->prods[g->n_prods - 1].derives_empty = 0;
-    g->prods[g->n_prods - 1].predict = NULL;
+    mem_free(g, rhsv[i]);
   }
 
-  free(rhsv);
+  mem_free(g, rhsv);
+  return g->status;
 }
 
 /* prods_print(): print the global productions list in a format that
@@ -241,8 +818,8 @@ void prods_print (grammar_t* g) {
   int lhs_prev = 0;
 
   for (int i = 0; i < g->n_prods; i++) {
-    int lhs = g->prods[i].lhs;
-    int *rhs = g->prods[i].rhs;
+    int lhs = g->prod_lhs[i];
+    int *rhs = g->rhs + g->prod_off[i];
 
     if (lhs != lhs_prev) {
       printf("\n  %s :", g->symbols[lhs - 1].name);
@@ -255,7 +832,7 @@ void prods_print (grammar_t* g) {
       printf("|");
     }
 
-    for (int j = 0; j < symv_len(rhs); j++)
+    for (int j = 0; j < g->prod_len[i]; j++)
       printf(" %s", g->symbols[rhs[j] - 1].name);
 
     printf("\n");
@@ -266,11 +843,11 @@ void prods_print (grammar_t* g) {
  */
 void prods_print_predict (grammar_t* g) {
   for (int i = 0; i < g->n_prods; i++) {
-    int lhs = g->prods[i].lhs;
-    int *rhs = g->prods[i].rhs;
+    int lhs = g->prod_lhs[i];
+    int *rhs = g->rhs + g->prod_off[i];
 
     printf("  %s :", g->symbols[lhs - 1].name);
-    for (int j = 0; j < symv_len(rhs); j++)
+    for (int j = 0; j < g->prod_len[i]; j++)
       printf(" %s", g->symbols[rhs[j] - 1].name);
 
     symv_print(g, g->prods[i].predict);
@@ -280,7 +857,7 @@ void prods_print_predict (grammar_t* g) {
 /* symv_len(): get the length of a symbol array. symbols are one-based, so
  * a zero-terminator is used to mark the end of the array.
  */
-int symv_len (int *sv) {
+int symv_len (const int *sv) {
   if (!sv)
     return 0;
 
@@ -293,8 +870,8 @@ int symv_len (int *sv) {
 
 /* symv_new(): construct a new symbol array from a single symbol.
  */
-int *symv_new (int s) {
-  int *sv = (int*) malloc(2 * sizeof(int));
+int *symv_new (grammar_t* g, int s) {
+  int *sv = (int*) mem_alloc(g, MEM_TEMP, 2 * sizeof(int));
   if (!sv)
     return NULL;
 
@@ -307,45 +884,42 @@ int *symv_new (int s) {
 /* symv_add(): create a new symbol array that contains both @sv and @s,
  * free @sv, and return the new array.
  */
-int *symv_add (int *sv, int s) {
+int *symv_add (grammar_t* g, int *sv, int s) {
   if (!sv)
-    return symv_new(s);
+    return symv_new(g, s);
 
   int nv = symv_len(sv);
-  int *snew = (int*) malloc((nv + 2) * sizeof(int));
+  int *snew = (int*) mem_realloc(g, MEM_TEMP, sv, (nv + 2) * sizeof(int));
   if (!snew) {
-    free(sv);
+    mem_free(g, sv);
     return NULL;
   }
 
-  memcpy(snew, sv, nv * sizeof(int));
-
   snew[nv] = s;
   snew[nv + 1] = 0;
 
-  free(sv);
   return snew;
 }
 
 /* symv_incl(): create a new array as in symv_add(), but do not add
  * duplicate symbols to the array.
  */
-int *symv_incl (int *sv, int s) {
+int *symv_incl (grammar_t* g, int *sv, int s) {
   if (!sv)
-    return symv_new(s);
+    return symv_new(g, s);
 
   for (int i = 0; i < symv_len(sv); i++) {
     if (sv[i] == s)
       return sv;
   }
 
-  return symv_add(sv, s);
+  return symv_add(g, sv, s);
 }
 
 /* symv_intersect(): create a new array that is the intersection of the
  * sets (symbol arrays) @sva and @svb.
  */
-int *symv_intersect (int *sva, int *svb) {
+int *symv_intersect (grammar_t* g, int *sva, int *svb) {
   int ia, ib, na, nb, *result;
 
   result = NULL;
@@ -355,13 +929,108 @@ int *symv_intersect (int *sva, int *svb) {
   for (ia = 0; ia < na; ia++) {
     for (ib = 0; ib < nb; ib++) {
       if (svb[ib] == sva[ia])
-        result = symv_incl(result, sva[ia]);
+        result = symv_incl(g, result, sva[ia]);
     }
   }
 
   return result;
 }
 
+/* symv_hash(): compute the hash of the symbol array @sv.
+ */
+static unsigned int symv_hash (const int *sv) {
+  unsigned int h = 2166136261u;
+
+  for (; *sv; sv++)
+    h = (h ^ (unsigned int) *sv) * 16777619u;
+
+  return h ^ (h >> 15);
+}
+
+/* symv_compare(): qsort() comparison of two symbol indices.
+ */
+static int symv_compare (const void *a, const void *b) {
+  int x = *(const int*) a, y = *(const int*) b;
+
+  return (x > y) - (x < y);
+}
+
+/* symv_intern(): take ownership of the symbol array @sv and return the
+ * interned array of class @cls holding the same symbols, sorted in
+ * symbol order. if one is already stored, @sv is freed. interned arrays
+ * are shared, so that identical sets compare equal by pointer whatever
+ * order their symbols were found in, and must not be modified.
+ */
+int *symv_intern (grammar_t* g, int cls, int *sv) {
+  struct set_store *s = g->sets + cls;
+
+  if (!sv || g->status) {
+    mem_free(g, sv);
+    return NULL;
+  }
+
+  /* keep the table at most half full. */
+  if (2 * (s->n + 1) > s->cap) {
+    int cap = (s->cap ? 2 * s->cap : 16);
+    int **table = (int**) mem_alloc(g, cls, cap * sizeof(int*));
+
+    if (!table) {
+      mem_free(g, sv);
+      return NULL;
+    }
+
+    memset(table, 0, cap * sizeof(int*));
+
+    for (int i = 0; i < s->cap; i++) {
+      if (!s->table[i])
+        continue;
+
+      unsigned int j = symv_hash(s->table[i]) & (cap - 1);
+      while (table[j])
+        j = (j + 1) & (cap - 1);
+
+      table[j] = s->table[i];
+    }
+
+    mem_free(g, s->table);
+    s->table = table;
+    s->cap = cap;
+  }
+
+  int n = symv_len(sv);
+  qsort(sv, n, sizeof(int), symv_compare);
+
+  unsigned int j = symv_hash(sv) & (s->cap - 1);
+
+  for (; s->table[j]; j = (j + 1) & (s->cap - 1)) {
+    if (symv_len(s->table[j]) == n &&
+        memcmp(s->table[j], sv, n * sizeof(int)) == 0) {
+      mem_free(g, sv);
+      return s->table[j];
+    }
+  }
+
+  mem_reclass(g, sv, cls);
+  s->table[j] = sv;
+  s->n++;
+
+  return sv;
+}
+
+/* symv_store_free(): deallocate every interned symbol array.
+ */
+void symv_store_free (grammar_t* g) {
+  for (int c = 0; c < MEM_N_CLASSES; c++) {
+    struct set_store *s = g->sets + c;
+
+    for (int i = 0; i < s->cap; i++)
+      mem_free(g, s->table[i]);
+
+    mem_free(g, s->table);
+    memset(s, 0, sizeof(struct set_store));
+  }
+}
+
 /* symv_print(): print the symbols (as strings) within a symbol array,
  * making sure to keep pretty pretty formatting.
  */
@@ -409,10 +1078,12 @@ int symvv_len (int **vv) {
 /* symvv_new(): construct a new symbol double-array from a single symbol
  * array.
  */
-int **symvv_new (int *v) {
-  int **vv = (int**) malloc(2 * sizeof(int*));
-  if (!vv)
+int **symvv_new (grammar_t* g, int *v) {
+  int **vv = (int**) mem_alloc(g, MEM_TEMP, 2 * sizeof(int*));
+  if (!vv) {
+    mem_free(g, v);
     return NULL;
+  }
 
   vv[0] = v;
   vv[1] = NULL;
@@ -423,32 +1094,33 @@ int **symvv_new (int *v) {
 /* symvv_add(): create a new symbol double-array that contains both @vv
  * and @v, free @vv, and return the new double-array.
  */
-int **symvv_add (int **vv, int *v) {
+int **symvv_add (grammar_t* g, int **vv, int *v) {
   int nv = symvv_len(vv);
-  int **vnew = (int**) malloc((nv + 2) * sizeof(int*));
+  int **vnew = (int**) mem_realloc(g, MEM_TEMP, vv, (nv + 2) * sizeof(int*));
   if (!vnew) {
-    free(vv);
+    for (int i = 0; i < nv; i++)
+      mem_free(g, vv[i]);
+
+    mem_free(g, vv);
+    mem_free(g, v);
     return NULL;
   }
 
-  memcpy(vnew, vv, nv * sizeof(int*));
-
   vnew[nv] = v;
   vnew[nv + 1] = 0;
 
-  free(vv);
   return vnew;
 }
 
 /* derives_empty_check_prod(): internal worker function for derives_empty().
  */
 void derives_empty_check_prod (grammar_t* g, int i, int **work) {
-  if (g->prods[i].yield == 0) {
-    g->prods[i].derives_empty = 1;
+  if (g->prod_yield[i] == 0) {
+    bits_set(g->prod_empty, i);
 
-    if (g->symbols[g->prods[i].lhs - 1].derives_empty == 0) {
-      g->symbols[g->prods[i].lhs - 1].derives_empty = 1;
-      *work = symv_add(*work, g->prods[i].lhs);
+    if (!bits_test(g->sym_empty, g->prod_lhs[i] - 1)) {
+      bits_set(g->sym_empty, g->prod_lhs[i] - 1);
+      *work = symv_add(g, *work, g->prod_lhs[i]);
     }
   }
 }
@@ -456,43 +1128,53 @@ void derives_empty_check_prod (grammar_t* g, int i, int **work) {
 /* derives_empty(): determine which symbols and productions in the grammar
  * are capable of deriving epsilon in any number of steps.
  */
-void derives_empty (grammar_t* g) {
+int derives_empty (grammar_t* g) {
   int i, j, k;
 
   int *work = NULL;
   int n_work = 0;
 
-  for (i = 0; i < g->n_symbols; i++) {
-    if (symbol_is_empty(g, i + 1))
-      g->symbols[i].derives_empty = 1;
-    else
-      g->symbols[i].derives_empty = 0;
-  }
+  grammar_phase(g, PHASE_EMPTY);
+  if (symbols_number(g))
+    return g->status;
+
+  if (g->engine == ENGINE_OPTIMIZED)
+    return engine_derives_empty(g);
+
+  for (i = 0; i < g->n_symbols; i++)
+    bits_put(g->sym_empty, i, symbol_is_empty(g, i + 1));
 
   for (i = 0; i < g->n_prods; i++) {
-    g->prods[i].yield = 0;
-    g->prods[i].derives_empty = 0;
+    g->prod_yield[i] = 0;
+    bits_clear(g->prod_empty, i);
+
+    int *rhs = g->rhs + g->prod_off[i];
 
-    for (j = 0; j < symv_len(g->prods[i].rhs); j++) {
-      if (!symbol_is_empty(g, g->prods[i].rhs[j]))
-        g->prods[i].yield++;
+    for (j = 0; j < g->prod_len[i]; j++) {
+      if (!symbol_is_empty(g, rhs[j]))
+        g->prod_yield[i]++;
     }
 
     derives_empty_check_prod(g, i, &work);
   }
 
   n_work = symv_len(work);
-  while (n_work) {
+  while (n_work && !g->status) {
     k = work[0];
     work[0] = work[n_work - 1];
     work[n_work - 1] = 0;
 
+    if (work_step(g, k))
+      break;
+
     for (i = 0; i < g->n_prods; i++) {
-      for (j = 0; j < symv_len(g->prods[i].rhs); j++) {
-        if (g->prods[i].rhs[j] != k)
+      int *rhs = g->rhs + g->prod_off[i];
+
+      for (j = 0; j < g->prod_len[i]; j++) {
+        if (rhs[j] != k)
           continue;
 
-        g->prods[i].yield--;
+        g->prod_yield[i]--;
         derives_empty_check_prod(g, i, &work);
       }
     }
@@ -500,100 +1182,152 @@ void derives_empty (grammar_t* g) {
     n_work = symv_len(work);
   }
 
-  free(work);
+  mem_free(g, work);
+  return g->status;
+}
+
+/* symv_merge(): include every symbol of @set into @result, leaving
+ * @set untouched.
+ */
+static int *symv_merge (grammar_t* g, int *result, const int *set) {
+  for (int j = 0; j < symv_len(set) && !g->status; j++)
+    result = symv_incl(g, result, set[j]);
+
+  return result;
+}
+
+/* first_set_merge(): include every symbol of @set into @result, then
+ * free @set. worker function for first_set() and follow_set().
+ */
+int *first_set_merge (grammar_t* g, int *result, int *set) {
+  result = symv_merge(g, result, set);
+
+  mem_free(g, set);
+  return result;
 }
 
 /* first_set(): determine the @first set of a given set of symbols.
  */
 int *first_set (grammar_t* g, int *set) {
-  int i, j, *result, *fi_rhs;
+  int i, *result;
 
   if (symv_len(set) == 0)
-    return symv_new(0);
+    return symv_new(g, 0);
 
-  if (g->symbols[set[0] - 1].is_terminal)
-    return symv_new(set[0]);
+  if (bits_test(g->sym_terminal, set[0] - 1))
+    return symv_new(g, set[0]);
 
   result = NULL;
 
-  if (g->symbols[set[0] - 1].visited == 0) {
-    g->symbols[set[0] - 1].visited = 1;
+  if (!bits_test(g->sym_visited, set[0] - 1)) {
+    bits_set(g->sym_visited, set[0] - 1);
 
-    for (i = 0; i < g->n_prods; i++) {
-      if (g->prods[i].lhs != set[0])
+    for (i = 0; i < g->n_prods && !g->status; i++) {
+      if (g->prod_lhs[i] != set[0])
         continue;
 
-      fi_rhs = first_set(g, g->prods[i].rhs);
-      for (j = 0; j < symv_len(fi_rhs); j++)
-        result = symv_incl(result, fi_rhs[j]);
+      if (work_step(g, 0))
+        break;
 
-      free(fi_rhs);
+      int *rhs = g->rhs + g->prod_off[i];
+      result = first_set_merge(g, result, first_set(g, rhs));
     }
   }
 
-  if (g->symbols[set[0] - 1].derives_empty) {
-    fi_rhs = first_set(g, set + 1);
-    for (j = 0; j < symv_len(fi_rhs); j++)
-      result = symv_incl(result, fi_rhs[j]);
-
-    free(fi_rhs);
-  }
+  if (bits_test(g->sym_empty, set[0] - 1) && !g->status)
+    result = first_set_merge(g, result, first_set(g, set + 1));
 
   return result;
 }
 
-/* first(): compute the @first sets of all symbols in the grammar.
+/* first_suffixes(): compute the first set and nullability of every
+ * right-hand side suffix, walking each production right to left so that
+ * every suffix extends the one after it.
  */
-void first (grammar_t* g) {
-  for (int i = 0; i < g->n_symbols; i++) {
-    symbols_reset_visited(g);
+static int first_suffixes (grammar_t* g) {
+  if (suffixes_alloc(g))
+    return g->status;
+
+  for (int i = 0; i < g->n_prods && !work_step(g, g->prod_lhs[i]); i++) {
+    for (int k = g->prod_off[i] + g->prod_len[i] - 1;
+         k >= g->prod_off[i] && !g->status; k--) {
+      int s = g->rhs[k], *set = g->symbols[s - 1].first;
+      bool empty = bits_test(g->sym_empty, s - 1);
+
+      bits_put(g->suffix_empty, k, empty &&
+                                   bits_test(g->suffix_empty, k + 1));
+
+      /* only a nonterminal deriving epsilon extends the suffix after it. */
+      if (empty && !bits_test(g->sym_terminal, s - 1)) {
+        set = symv_merge(g, symv_merge(g, NULL, set), g->suffix_first[k + 1]);
+        set = symv_intern(g, MEM_FIRST, set);
+      }
 
-    int *set = symv_new(i + 1);
-    g->symbols[i].first = first_set(g, set);
-    free(set);
+      g->suffix_first[k] = set;
+    }
   }
+
+  return g->status;
 }
 
-/* follow_set_allempty(): worker function for follow_set().
+/* first(): compute the @first sets of all symbols in the grammar, and
+ * of every right-hand side suffix.
  */
-int follow_set_allempty (grammar_t* g, int *set) {
-  for (int i = 0; i < symv_len(set); i++) {
-    if (g->symbols[set[i] - 1].derives_empty == 0 ||
-        g->symbols[set[i] - 1].is_terminal)
-      return 0;
+int first (grammar_t* g) {
+  grammar_phase(g, PHASE_FIRST);
+  if (!g->dense && symbols_number(g))
+    return g->status;
+
+  if (g->engine == ENGINE_OPTIMIZED)
+    return engine_first(g);
+
+  for (int i = 0; i < g->n_symbols && !g->status; i++) {
+    symbols_reset_visited(g);
+
+    if (!bits_test(g->sym_terminal, i) && work_step(g, i + 1))
+      break;
+
+    int *set = symv_new(g, i + 1);
+    if (!set)
+      break;
+
+    g->symbols[i].first = symv_intern(g, MEM_FIRST, first_set(g, set));
+    mem_free(g, set);
   }
 
-  return 1;
+  if (!g->status)
+    first_suffixes(g);
+
+  return g->status;
 }
 
-/* follow_set(): determine the @follow set of a given nonterminal.
+/* follow_set(): determine the @follow set of a given nonterminal, from
+ * the first set of the suffix after each of its occurrences and, where
+ * that suffix derives epsilon, the follow set of the left-hand side.
  */
 int *follow_set (grammar_t* g, int sym) {
   int *result = NULL;
 
-  if (g->symbols[sym - 1].visited == 0) {
-    g->symbols[sym - 1].visited = 1;
+  if (!bits_test(g->sym_visited, sym - 1)) {
+    bits_set(g->sym_visited, sym - 1);
 
-    for (int i = 0; i < g->n_prods; i++) {
-      for (int j = 0; j < symv_len(g->prods[i].rhs); j++) {
-        if (g->prods[i].rhs[j] != sym)
-          continue;
+    for (int i = 0; i < g->n_prods && !g->status; i++) {
+      int *rhs = g->rhs + g->prod_off[i];
 
-        int *tail = g->prods[i].rhs + (j + 1);
+      if (work_step(g, 0))
+        break;
 
-        if (*tail) {
-          int *fi = g->symbols[*tail - 1].first;
-          for (int k = 0; k < symv_len(fi); k++)
-            result = symv_incl(result, fi[k]);
-        }
+      for (int j = 0; j < g->prod_len[i] && !g->status; j++) {
+        int k = g->prod_off[i] + j + 1;
 
-        if (follow_set_allempty(g, tail)) {
-          int *fo = follow_set(g, g->prods[i].lhs);
-          for (int k = 0; k < symv_len(fo); k++)
-            result = symv_incl(result, fo[k]);
+        if (rhs[j] != sym)
+          continue;
 
-          free(fo);
-        }
+        result = symv_merge(g, result, g->suffix_first[k]);
+
+        if (bits_test(g->suffix_empty, k))
+          result = first_set_merge(g, result,
+                                   follow_set(g, g->prod_lhs[i]));
       }
     }
   }
@@ -603,16 +1337,21 @@ int *follow_set (grammar_t* g, int sym) {
 
 /* follow(): compute the @follow sets of all symbols in the grammar.
  */
-void follow (grammar_t* g) {
-  for (int i = 0; i < g->n_symbols; i++) {
+int follow (grammar_t* g) {
+  grammar_phase(g, PHASE_FOLLOW);
+  if (!g->dense && symbols_number(g))
+    return g->status;
+
+  if (g->engine == ENGINE_OPTIMIZED)
+    return engine_follow(g);
+
+  for (int i = 0; i < g->n_symbols && !g->status; i++) {
     symbols_reset_visited(g);
 
-    if (g->symbols[i].is_terminal)
+    if (bits_test(g->sym_terminal, i) || work_step(g, i + 1))
       continue;
 
-    g->symbols[i].follow = follow_set(g, i + 1);
-
-    int *fo = g->symbols[i].follow;
+    int *fo = follow_set(g, i + 1);
     int nfo = symv_len(fo);
 
     for (int j = 0; j < nfo; j++) {
@@ -622,23 +1361,24 @@ void follow (grammar_t* g) {
         break;
       }
     }
+
+    g->symbols[i].follow = symv_intern(g, MEM_FOLLOW, fo);
   }
+
+  return g->status;
 }
 
-/* predict_set(): determine the predict set of a given production.
+/* predict_set(): determine the predict set of a given production, from
+ * the first set of its right-hand side and, if it derives epsilon, the
+ * follow set of its left-hand side.
  */
-int *predict_set (grammar_t* g, int iprod, int *set) {
-  symbols_reset_visited(g);
-  int *result = first_set(g ,set);
+int *predict_set (grammar_t* g, int iprod) {
+  int *result = symv_merge(g, NULL, g->suffix_first[g->prod_off[iprod]]);
 
-  if (g->prods[iprod].derives_empty) {
+  if (bits_test(g->prod_empty, iprod) && !g->status) {
     symbols_reset_visited(g);
-    int *fo = follow_set(g, g->prods[iprod].lhs);
-
-    for (int i = 0; i < symv_len(fo); i++)
-      result = symv_incl(result, fo[i]);
-
-    free(fo);
+    result = first_set_merge(g, result,
+                             follow_set(g, g->prod_lhs[iprod]));
   }
 
   return result;
@@ -646,20 +1386,28 @@ int *predict_set (grammar_t* g, int iprod, int *set) {
 
 /* predict(): compute the @predict sets of all productions in the grammar.
  */
-void predict (grammar_t* g) {
-  for (int i = 0; i < g->n_symbols; i++) {
+int predict (grammar_t* g) {
+  grammar_phase(g, PHASE_PREDICT);
+  if (!g->dense && symbols_number(g))
+    return g->status;
+
+  if (g->engine == ENGINE_OPTIMIZED)
+    return engine_predict(g);
+
+  for (int i = 0; i < g->n_symbols && !g->status; i++) {
     int lhs = i + 1;
 
-    if (g->symbols[i].is_terminal)
+    if (bits_test(g->sym_terminal, i))
       continue;
 
-    for (int j = 0; j < g->n_prods; j++) {
-      if (g->prods[j].lhs != lhs)
+    for (int j = 0; j < g->n_prods && !g->status; j++) {
+      if (g->prod_lhs[j] != lhs)
         continue;
 
-      g->prods[j].predict = predict_set(g, j, g->prods[j].rhs);
+      if (work_step(g, lhs))
+        break;
 
-      int *pred = g->prods[j].predict;
+      int *pred = predict_set(g, j);
       int npred = symv_len(pred);
 
       for (int k = 0; k < npred; k++) {
@@ -669,63 +1417,228 @@ void predict (grammar_t* g) {
           break;
         }
       }
+
+      g->prods[j].predict = symv_intern(g, MEM_PREDICT, pred);
     }
   }
+
+  return g->status;
 }
 
 /* conflicts_print(): print information about a predict set overlap
  * for a single pair of productions indexed by @id1 and @id2.
  */
 void conflicts_print (grammar_t* g, int id1, int id2, int *overlap) {
-  printf("  %s :", g->symbols[g->prods[id1].lhs - 1].name);
-  for (int i = 0; i < symv_len(g->prods[id1].rhs); i++)
-    printf(" %s", g->symbols[g->prods[id1].rhs[i] - 1].name);
+  const int *rhs1 = g->rhs + g->prod_off[id1];
+  const int *rhs2 = g->rhs + g->prod_off[id2];
+
+  printf("  %s :", g->symbols[g->prod_lhs[id1] - 1].name);
+  for (int i = 0; i < g->prod_len[id1]; i++)
+    printf(" %s", g->symbols[rhs1[i] - 1].name);
 
-  printf("\n  %s :", g->symbols[g->prods[id2].lhs - 1].name);
-  for (int i = 0; i < symv_len(g->prods[id2].rhs); i++)
-    printf(" %s", g->symbols[g->prods[id2].rhs[i] - 1].name);
+  printf("\n  %s :", g->symbols[g->prod_lhs[id2] - 1].name);
+  for (int i = 0; i < g->prod_len[id2]; i++)
+    printf(" %s", g->symbols[rhs2[i] - 1].name);
 
   symv_print(g, overlap);
 }
 
-/* conflicts(): print all LL(1) conflicts in a grammar, if any.
+/* conflicts_walk(): visit every pair of productions of the same
+ * nonterminal having overlapping predict sets, printing them if @print
+ * is set. the number of overlapping pairs is returned.
  */
-bool conflicts (grammar_t* g) {
-  bool header = false;
+int conflicts_walk (grammar_t* g, bool print) {
+  int n = 0;
 
-  for (int i = 0; i < g->n_symbols; i++) {
-    if (g->symbols[i].is_terminal)
+  grammar_phase(g, PHASE_CONFLICTS);
+
+  for (int i = 0; i < g->n_symbols && !g->status; i++) {
+    if (bits_test(g->sym_terminal, i))
       continue;
 
-    for (int j1 = 0; j1 < g->n_prods; j1++) {
+    for (int j1 = 0; j1 < g->n_prods && !g->status; j1++) {
       int *pred1 = g->prods[j1].predict;
-      if (g->prods[j1].lhs != i + 1)
+      if (g->prod_lhs[j1] != i + 1)
         continue;
 
       for (int j2 = j1 + 1; j2 < g->n_prods; j2++) {
         int *pred2 = g->prods[j2].predict;
-        if (g->prods[j2].lhs != i + 1)
+        if (g->prod_lhs[j2] != i + 1)
           continue;
 
-        int *u = symv_intersect(pred1, pred2);
+        if (work_step(g, i + 1))
+          break;
+
+        /* interned sets that are equal by pointer overlap entirely. */
+        int *u = (pred1 == pred2 ? NULL : symv_intersect(g, pred1, pred2));
+        int *overlap = (pred1 == pred2 ? pred1 : u);
 
-        if (symv_len(u)) {
-          if (!header) {
+        if (symv_len(overlap)) {
+          if (print && n == 0)
             printf("Conflicts:\n\n");
-            header = true;
-          }
 
-          conflicts_print(g, j1, j2, u);
+          if (print)
+            conflicts_print(g, j1, j2, overlap);
+
+          n++;
         }
 
-        free(u);
+        mem_free(g, u);
       }
     }
   }
 
+  return n;
+}
+
+/* conflicts_count(): get the number of pairs of productions in the
+ * grammar having overlapping predict sets, without printing them.
+ */
+int conflicts_count (grammar_t* g) {
+  return conflicts_walk(g, false);
+}
+
+/* conflicts(): print all LL(1) conflicts in a grammar, if any. no
+ * verdict is printed if the walk was cut short.
+ */
+bool conflicts (grammar_t* g) {
+  bool header = (conflicts_walk(g, true) > 0);
+
+  if (g->status)
+    return header;
+
   if (header)
     printf("There were conflicts.\nGrammar is not LL(1)\n  :(\n\n");
   else
     printf("No conflicts, grammar is LL(1)\n  :D :D :D\n\n");
   return header;
 }
+
+/* grammar_n_symbols(): get the number of symbols in the grammar.
+ */
+int grammar_n_symbols (grammar_t* g) {
+  return g->n_symbols;
+}
+
+/* grammar_n_prods(): get the number of productions in the grammar.
+ */
+int grammar_n_prods (grammar_t* g) {
+  return g->n_prods;
+}
+
+/* grammar_symbol_name(): get the name of the symbol having one-based
+ * index @sym, or NULL if no such symbol exists.
+ */
+const char *grammar_symbol_name (grammar_t* g, int sym) {
+  if (sym < 1 || sym > g->n_symbols)
+    return NULL;
+
+  return g->symbols[sym - 1].name;
+}
+
+/* grammar_is_terminal(): get whether the symbol @sym is a terminal.
+ */
+bool grammar_is_terminal (grammar_t* g, int sym) {
+  return (sym >= 1 && sym <= g->n_symbols &&
+          bits_test(g->sym_terminal, sym - 1));
+}
+
+/* grammar_nullable(): get whether the symbol @sym derives epsilon.
+ */
+bool grammar_nullable (grammar_t* g, int sym) {
+  return (sym >= 1 && sym <= g->n_symbols &&
+          bits_test(g->sym_empty, sym - 1));
+}
+
+/* grammar_first(): get the zero-terminated @first set of the symbol @sym,
+ * or NULL if the set is empty or has not been computed.
+ */
+const int *grammar_first (grammar_t* g, int sym) {
+  if (sym < 1 || sym > g->n_symbols)
+    return NULL;
+
+  return g->symbols[sym - 1].first;
+}
+
+/* grammar_follow(): get the zero-terminated @follow set of the
+ * nonterminal @sym, or NULL if the set is empty or has not been computed.
+ */
+const int *grammar_follow (grammar_t* g, int sym) {
+  if (sym < 1 || sym > g->n_symbols)
+    return NULL;
+
+  return g->symbols[sym - 1].follow;
+}
+
+/* grammar_prod_lhs(): get the left-hand side symbol of the zero-based
+ * production @prod, or zero if no such production exists.
+ */
+int grammar_prod_lhs (grammar_t* g, int prod) {
+  if (prod < 0 || prod >= g->n_prods)
+    return 0;
+
+  return g->prod_lhs[prod];
+}
+
+/* grammar_prod_rhs(): get the zero-terminated right-hand side of the
+ * zero-based production @prod.
+ */
+const int *grammar_prod_rhs (grammar_t* g, int prod) {
+  if (prod < 0 || prod >= g->n_prods)
+    return NULL;
+
+  return g->rhs + g->prod_off[prod];
+}
+
+/* grammar_predict(): get the zero-terminated @predict set of the
+ * zero-based production @prod.
+ */
+const int *grammar_predict (grammar_t* g, int prod) {
+  if (prod < 0 || prod >= g->n_prods)
+    return NULL;
+
+  return g->prods[prod].predict;
+}
+
+/* grammar_n_terminals(): get the number of terminals in the grammar.
+ */
+int grammar_n_terminals (grammar_t* g) {
+  return g->n_terms;
+}
+
+/* grammar_n_nonterminals(): get the number of nonterminals in the grammar.
+ */
+int grammar_n_nonterminals (grammar_t* g) {
+  return g->n_nonterms;
+}
+
+/* grammar_terminal(): get the symbol of the terminal having dense
+ * zero-based index @t, or zero if no such terminal exists.
+ */
+int grammar_terminal (grammar_t* g, int t) {
+  if (t < 0 || t >= g->n_terms)
+    return 0;
+
+  return g->terms[t];
+}
+
+/* grammar_nonterminal(): get the symbol of the nonterminal having dense
+ * zero-based index @n, or zero if no such nonterminal exists.
+ */
+int grammar_nonterminal (grammar_t* g, int n) {
+  if (n < 0 || n >= g->n_nonterms)
+    return 0;
+
+  return g->nonterms[n];
+}
+
+/* grammar_dense_index(): get the dense zero-based index of the symbol
+ * @sym among the terminals or nonterminals, or -1 if no such symbol
+ * exists or the symbols have not been numbered.
+ */
+int grammar_dense_index (grammar_t* g, int sym) {
+  if (sym < 1 || sym > g->n_symbols || !g->dense)
+    return -1;
+
+  return g->dense[sym - 1];
+}
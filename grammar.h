@@ -1,15 +1,136 @@
 #ifndef GRAMMAR_H
 #define GRAMMAR_H
 
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 
+#include "bitset.h"
+
+/* status codes returned by the library functions. zero always denotes
+ * success, and the first failure is kept in the grammar until it is
+ * freed.
+ */
+typedef enum ll1_status {
+  LL1_OK = 0,
+  LL1_ENOMEM,   /* unable to allocate memory. */
+  LL1_EIO,      /* unable to read or write a file. */
+  LL1_EPARSE,   /* syntax error in the input grammar. */
+  LL1_EFORMAT,  /* malformed compiled grammar image. */
+  LL1_EBUDGET,  /* memory budget of the grammar exceeded. */
+  LL1_ELIMIT    /* time or step limit of the grammar exceeded. */
+} ll1_status;
+
+/* classes of memory accounted separately by each grammar. */
+enum mem_class {
+  MEM_SYMBOLS,  /* symbol table, names and aliases. */
+  MEM_PRODS,    /* production list and right-hand sides. */
+  MEM_FIRST,    /* first sets of all symbols. */
+  MEM_FOLLOW,   /* follow sets of all nonterminals. */
+  MEM_PREDICT,  /* predict sets of all productions. */
+  MEM_LR,       /* lr(0) automaton and its lookahead sets. */
+  MEM_TEMP,     /* temporaries of parsing and analysis. */
+  MEM_N_CLASSES
+};
+
+/* phases of grammar processing, used to attribute memory use and to
+ * name the culprit of a failure.
+ */
+enum phase {
+  PHASE_NONE,
+  PHASE_PARSE,
+  PHASE_LOAD,
+  PHASE_PRUNE,
+  PHASE_EMPTY,
+  PHASE_FIRST,
+  PHASE_FOLLOW,
+  PHASE_PREDICT,
+  PHASE_CONFLICTS,
+  PHASE_LR,
+  PHASE_N_PHASES
+};
+
+/* analysis engines computing the empty, first, follow and predict sets.
+ * both produce identical results; the reference engine is kept as the
+ * baseline that the optimized engine is checked against.
+ */
+enum engine {
+  ENGINE_OPTIMIZED,
+  ENGINE_REFERENCE
+};
+
+/* data structure for holding the memory use shared by grammars that
+ * parse parts of one grammar, possibly on several threads: their current
+ * @total and its @peak, which are also charged to the enclosing shared
+ * use @up, if any.
+ */
+struct mem_shared {
+  atomic_size_t total, peak;
+  struct mem_shared *up;
+};
+
+/* data structure for holding the memory accounting of a grammar.
+ */
+struct mem_stats {
+  /* @cur and @peak bytes allocated in each class. */
+  size_t cur[MEM_N_CLASSES], peak[MEM_N_CLASSES];
+
+  /* @total bytes allocated, and its @peak_total. */
+  size_t total, peak_total;
+
+  /* @phase_peak total bytes allocated during each phase. */
+  size_t phase_peak[PHASE_N_PHASES];
+
+  /* @limit on the total bytes allocated, or zero for no limit. */
+  size_t limit;
+
+  /* @shared use that every allocation is also charged to, and that the
+   * @limit then applies to, or NULL.
+   */
+  struct mem_shared *shared;
+};
+
+/* data structure for holding the work done on a grammar, and its limits.
+ */
+struct work_stats {
+  /* @steps taken in each phase, and the @budget of steps of each phase,
+   * or zero for no budget.
+   */
+  long steps[PHASE_N_PHASES], budget[PHASE_N_PHASES];
+
+  /* @timeout in seconds after the @start time, or zero for no limit. */
+  double timeout, start;
+
+  /* one-based index of the nonterminal being worked on, or zero. */
+  int current;
+};
+
+/* data structure for holding the interned sets of one memory class, as
+ * an open addressing hash @table of @cap slots, @n of them pointing to
+ * distinct symbol arrays.
+ */
+struct set_store {
+  int **table;
+  int n, cap;
+};
+
+/* maximum length of the error message stored in a grammar. */
+#define LL1_ERRMSG_MAX 256
+
+/* data structure for holding the input of the lexer: the @len bytes of
+ * grammar text at @buf, read up to offset @pos, and the @name and first
+ * @line number used in error messages.
+ */
 typedef struct file_t {
-  FILE* descriptor;
+  const char* buf;
+  size_t pos, len;
   char* name;
+  int line;
 } file_t;
 
-/* data structure for holding grammar symbol information.
+/* data structure for holding grammar symbol information. the flags of
+ * each symbol are held apart, in the bitmaps of the grammar.
  */
 struct symbol {
   /* symbol @name */
@@ -17,27 +138,13 @@ struct symbol {
 
   /* @first and @follow sets for non-terminal symbols. */
   int *first, *follow;
-  int visited;
-
-  /* whether the symbol @is_terminal or @derives_empty. */
-  int is_terminal;
-  int derives_empty;
 };
 
-/* data structure for holding productions of the grammar.
+/* data structure for holding productions of the grammar. the left-hand
+ * side, right-hand side, yield and flags of each production are held
+ * apart, in parallel arrays of the grammar.
  */
 struct production {
-  /* @lhs: left-hand side one-based symbol table index.
-   * @rhs: right-hand side one-based symbol table indices.
-   */
-  int lhs, *rhs;
-
-  /* terminal @yield of nonterminals and whether
-   * a nonterminal @derives_empty.
-   */
-  int yield;
-  int derives_empty;
-
   /* @predict set for each production. */
   int *predict;
 };
@@ -52,26 +159,156 @@ typedef struct grammar_t {
 	 struct alias* aliases;
 	 int alias_count;
 
+	/* names of the @n_includes modules requested by include directives,
+	 * in the order they were read.
+	 */
+	 char **includes;
+	 int n_includes;
+
 	/* symbol table. */
 	 struct symbol *symbols;
 	 int n_symbols;
 
+	/* per-symbol flags, as bitmaps holding zero-based symbol indices:
+	 * whether each symbol is a terminal (@sym_terminal), derives epsilon
+	 * (@sym_empty) or has been visited by a set construction
+	 * (@sym_visited).
+	 */
+	 bits_t *sym_terminal, *sym_empty, *sym_visited;
+
+	/* dense numbering of the symbols of each kind: @terms and @nonterms
+	 * hold the one-based indices of the @n_terms terminals and @n_nonterms
+	 * nonterminals in symbol order, and @dense maps every symbol back to
+	 * its zero-based position among those of its kind.
+	 */
+	 int *terms, n_terms;
+	 int *nonterms, n_nonterms;
+	 int *dense;
+
 	/* production list. */
 	 struct production *prods;
 	 int n_prods;
+
+	/* interned @sets of each memory class. the first, follow and predict
+	 * sets of the grammar are shared by every symbol or production having
+	 * the same set, and are never modified or freed on their own.
+	 */
+	 struct set_store sets[MEM_N_CLASSES];
+
+	/* per-production fields, as parallel arrays: the one-based left-hand
+	 * side symbol (@prod_lhs) and the number of right-hand side symbols
+	 * not yet known to derive epsilon (@prod_yield) of each production,
+	 * and a bitmap of the productions that derive epsilon (@prod_empty).
+	 */
+	 int *prod_lhs, *prod_yield;
+	 bits_t *prod_empty;
+
+	/* right-hand sides of all productions, stored back to back in the
+	 * @n_rhs entries (of @rhs_cap allocated) of @rhs. the one-based symbol
+	 * table indices of each production start at @prod_off and run for
+	 * @prod_len entries, followed by a zero terminator.
+	 */
+	 int *rhs, n_rhs, rhs_cap;
+	 int *prod_off, *prod_len;
+
+	/* first sets and nullability of every right-hand side suffix, by its
+	 * starting position in @rhs: @suffix_first holds the interned first
+	 * set of the symbols from that position up to the terminator, and
+	 * the bitmap @suffix_empty whether all of them derive epsilon.
+	 */
+	 int **suffix_first;
+	 bits_t *suffix_empty;
+
+	/* @status of the first failed operation and its @errmsg. */
+	 int status;
+	 char errmsg[LL1_ERRMSG_MAX];
+
+	/* current processing @phase, accounting of memory use and of the
+	 * @work done.
+	 */
+	 int phase;
+	 struct mem_stats mem;
+	 struct work_stats work;
+
+	/* analysis @engine used by the grammar. */
+	 int engine;
+
+	/* number of @threads parsing the grammar, or zero to choose it from
+	 * the size of the input.
+	 */
+	 int threads;
+
+	/* directory caching the parsed modules of the grammar, or NULL. */
+	 const char *cache_dir;
 } grammar_t;
 
+/* pre-declare grammar object functions. */
+void grammar_init (grammar_t* g);
+void grammar_free (grammar_t* g);
+int grammar_fail (grammar_t* g, int status, const char *fmt, ...);
+const char *grammar_error (grammar_t* g);
+const char *ll1_strerror (int status);
+void grammar_phase (grammar_t* g, int phase);
+const char *phase_name (int phase);
+
+/* pre-declare memory accounting functions. */
+void *mem_alloc (grammar_t* g, int cls, size_t n);
+void *mem_realloc (grammar_t* g, int cls, void *p, size_t n);
+char *mem_strdup (grammar_t* g, int cls, const char *s);
+void mem_reclass (grammar_t* g, void *p, int cls);
+void mem_free (grammar_t* g, void *p);
+void mem_set_limit (grammar_t* g, size_t limit);
+void mem_share_begin (grammar_t* g, struct mem_shared *s);
+void mem_share_end (grammar_t* g);
+void mem_print (grammar_t* g);
+
+/* pre-declare work limit functions. */
+void work_set_timeout (grammar_t* g, double seconds);
+void work_set_budget (grammar_t* g, int phase, long steps);
+int work_step (grammar_t* g, int sym);
+
+/* pre-declare grammar input functions. */
+int grammar_parse_file (grammar_t* g, const char *fname);
+int grammar_parse_files (grammar_t* g, int n, char **fnames);
+int grammar_parse_buffer (grammar_t* g, const char *name,
+                          const char *buf, size_t len);
+
+/* pre-declare grammar accessor functions. */
+int grammar_n_symbols (grammar_t* g);
+int grammar_n_prods (grammar_t* g);
+const char *grammar_symbol_name (grammar_t* g, int sym);
+bool grammar_is_terminal (grammar_t* g, int sym);
+bool grammar_nullable (grammar_t* g, int sym);
+const int *grammar_first (grammar_t* g, int sym);
+const int *grammar_follow (grammar_t* g, int sym);
+int grammar_prod_lhs (grammar_t* g, int prod);
+const int *grammar_prod_rhs (grammar_t* g, int prod);
+const int *grammar_predict (grammar_t* g, int prod);
+int grammar_n_terminals (grammar_t* g);
+int grammar_n_nonterminals (grammar_t* g);
+int grammar_terminal (grammar_t* g, int t);
+int grammar_nonterminal (grammar_t* g, int n);
+int grammar_dense_index (grammar_t* g, int sym);
+
 /* pre-declare aliases table functions. */
 void aliases_init(grammar_t* g);
 void aliases_free(grammar_t* g);
-void aliases_add(grammar_t* g, char* symbol, char* alias);
+int aliases_add(grammar_t* g, char* symbol, char* alias);
 char* aliased_from(grammar_t* g, char* name);
 
+/* pre-declare include list functions. */
+void includes_init (grammar_t* g);
+void includes_free (grammar_t* g);
+int includes_add (grammar_t* g, char *name);
+
 /* pre-declare symbol table functions. */
 void symbols_init (grammar_t* g);
 void symbols_free (grammar_t* g);
+int symbol_is_empty (grammar_t* g, int sym);
 int symbols_find (grammar_t* g, char *name);
+int symbols_resize (grammar_t* g, int n);
 int symbols_add (grammar_t* g, char *name, int is_terminal);
+int symbols_number (grammar_t* g);
 void symbols_print (grammar_t* g, int is_terminal);
 void symbols_print_empty (grammar_t* g);
 void symbols_print_first (grammar_t* g);
@@ -80,29 +317,38 @@ void symbols_print_follow (grammar_t* g);
 /* pre-declare production list functions. */
 void prods_init (grammar_t* g);
 void prods_free (grammar_t* g);
-void prods_add (grammar_t* g, int lhs, int **rhsv);
+int prods_resize (grammar_t* g, int n);
+int *prods_append (grammar_t* g, int lhs, int len);
+int prods_add (grammar_t* g, int lhs, int **rhsv);
 void prods_print (grammar_t* g);
 void prods_print_predict (grammar_t* g);
 
 /* pre-declare functions to learn information about the grammar. */
-void derives_empty (grammar_t* g);
-void first (grammar_t* g);
-void follow (grammar_t* g);
-void predict (grammar_t* g);
+int prune (grammar_t* g, bool print);
+int derives_empty (grammar_t* g);
+int first (grammar_t* g);
+int follow (grammar_t* g);
+int predict (grammar_t* g);
+int conflicts_count (grammar_t* g);
 bool conflicts (grammar_t* g);
+void conflicts_print (grammar_t* g, int id1, int id2, int *overlap);
 
 /* pre-declare symbol array functions. */
-int symv_len (int *sv);
-int *symv_new (int s);
-int *symv_add (int *sv, int s);
+int symv_len (const int *sv);
+int *symv_new (grammar_t* g, int s);
+int *symv_add (grammar_t* g, int *sv, int s);
+int *symv_intersect (grammar_t* g, int *sva, int *svb);
+int *symv_intern (grammar_t* g, int cls, int *sv);
+void symv_store_free (grammar_t* g);
 void symv_print (grammar_t* g, int *sv);
 
 /* pre-declare symbol double-array functions. */
 int symvv_len (int **vv);
-int **symvv_new (int *v);
-int **symvv_add (int **vv, int *v);
+int **symvv_new (grammar_t* g, int *v);
+int **symvv_add (grammar_t* g, int **vv, int *v);
 
 #define STR_EPSILON "%empty"
 #define STR_TOKEN "%token"
+#define STR_INCLUDE "%include"
 
 #endif
@@ -0,0 +1,990 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "compiled.h"
+#include "grammar.h"
+#include "ll1.h"
+
+/* smallest share of the input worth parsing on a thread of its own, and
+ * the largest number of threads used.
+ */
+#define PARSE_CHUNK_MIN (512 * 1024)
+#define PARSE_THREADS_MAX 64
+
+/* the lexer works on the whole grammar text at once. runs of whitespace,
+ * identifiers and comments are scanned a block of bytes at a time with
+ * SSE2 or AVX2, when the compiler targets them, and byte by byte through
+ * a class table otherwise.
+ */
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+#define LEX_BLOCK 32
+#define LEX_FULL 0xffffffffu
+
+typedef __m256i vec_t;
+
+#define vec_load(p)   _mm256_loadu_si256((const __m256i*) (p))
+#define vec_splat(c)  _mm256_set1_epi8((char) (c))
+#define vec_eq(a, b)  _mm256_cmpeq_epi8(a, b)
+#define vec_gt(a, b)  _mm256_cmpgt_epi8(a, b)
+#define vec_add(a, b) _mm256_add_epi8(a, b)
+#define vec_or(a, b)  _mm256_or_si256(a, b)
+#define vec_mask(a)   ((uint32_t) _mm256_movemask_epi8(a))
+
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+
+#define LEX_BLOCK 16
+#define LEX_FULL 0xffffu
+
+typedef __m128i vec_t;
+
+#define vec_load(p)   _mm_loadu_si128((const __m128i*) (p))
+#define vec_splat(c)  _mm_set1_epi8((char) (c))
+#define vec_eq(a, b)  _mm_cmpeq_epi8(a, b)
+#define vec_gt(a, b)  _mm_cmpgt_epi8(a, b)
+#define vec_add(a, b) _mm_add_epi8(a, b)
+#define vec_or(a, b)  _mm_or_si128(a, b)
+#define vec_mask(a)   ((uint32_t) _mm_movemask_epi8(a))
+#endif
+
+#ifdef LEX_BLOCK
+/* vec_in(): compare every byte of @v against the range [@lo, @lo + @n),
+ * by shifting the range down to the smallest signed bytes.
+ */
+#define vec_in(v, lo, n) \
+  vec_gt(vec_splat(-128 + (n)), vec_add(v, vec_splat(128 - (lo))))
+#endif
+
+/* character classes of the lexer. */
+#define LEX_SPACE 0x01  /* whitespace and control bytes. */
+#define LEX_IDENT 0x02  /* bytes continuing an identifier. */
+#define LEX_START 0x04  /* bytes starting an identifier or directive. */
+#define LEX_PUNCT 0x08  /* bytes starting any other token or comment. */
+
+#define W LEX_SPACE
+#define D LEX_IDENT
+#define L (LEX_IDENT | LEX_START)
+#define C LEX_START
+#define P LEX_PUNCT
+
+/* class of every byte value. bytes of no class are ignored. */
+static const unsigned char lex_class[256] = {
+  W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,
+  W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,
+  W, 0, P, 0, 0, C, 0, P, 0, 0, 0, 0, 0, 0, 0, P,
+  D, D, D, D, D, D, D, D, D, D, P, P, 0, 0, 0, 0,
+  0, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,
+  L, L, L, L, L, L, L, L, L, L, L, 0, 0, 0, 0, D,
+  0, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,
+  L, L, L, L, L, L, L, L, L, L, L, 0, P, 0, 0, 0
+};
+
+#undef W
+#undef D
+#undef L
+#undef C
+#undef P
+
+/* lex_skip_space(): get the first byte from @p that is not whitespace,
+ * or @end, adding the number of newlines skipped over to @line.
+ */
+static const char *lex_skip_space (const char *p, const char *end,
+                                   int *line) {
+  if (p < end && !(lex_class[(unsigned char) *p] & LEX_SPACE))
+    return p;
+
+#ifdef LEX_BLOCK
+  for (; end - p >= LEX_BLOCK; p += LEX_BLOCK) {
+    vec_t v = vec_load(p);
+    uint32_t ws = vec_mask(vec_in(v, 0x00, 0x21));
+    uint32_t nl = vec_mask(vec_eq(v, vec_splat('\n')));
+
+    if (ws != LEX_FULL) {
+      int k = __builtin_ctz(~ws);
+
+      *line += __builtin_popcount(nl & ((1u << k) - 1));
+      return p + k;
+    }
+
+    *line += __builtin_popcount(nl);
+  }
+#endif
+
+  for (; p < end && (lex_class[(unsigned char) *p] & LEX_SPACE); p++)
+    *line += (*p == '\n');
+
+  return p;
+}
+
+/* lex_scan_ident(): get the first byte from @p that cannot continue an
+ * identifier, or @end.
+ */
+static const char *lex_scan_ident (const char *p, const char *end) {
+#ifdef LEX_BLOCK
+  for (; end - p >= LEX_BLOCK; p += LEX_BLOCK) {
+    vec_t v = vec_load(p);
+    uint32_t id = vec_mask(vec_in(vec_or(v, vec_splat(0x20)), 'a', 26)) |
+                  vec_mask(vec_in(v, '0', 10)) |
+                  vec_mask(vec_eq(v, vec_splat('_')));
+
+    if (id != LEX_FULL)
+      return p + __builtin_ctz(~id);
+  }
+#endif
+
+  while (p < end && (lex_class[(unsigned char) *p] & LEX_IDENT))
+    p++;
+
+  return p;
+}
+
+/* lex_count_lines(): get the number of newlines from @p up to @end.
+ */
+static int lex_count_lines (const char *p, const char *end) {
+  int n = 0;
+
+#ifdef LEX_BLOCK
+  for (; end - p >= LEX_BLOCK; p += LEX_BLOCK)
+    n += __builtin_popcount(vec_mask(vec_eq(vec_load(p), vec_splat('\n'))));
+#endif
+
+  for (; p < end; p++)
+    n += (*p == '\n');
+
+  return n;
+}
+
+/* lex_comment_end(): get the first "*" followed by "/" from @p, or NULL
+ * if there is none before @end.
+ */
+static const char *lex_comment_end (const char *p, const char *end) {
+#ifdef LEX_BLOCK
+  for (; end - p > LEX_BLOCK; p += LEX_BLOCK) {
+    uint32_t m = vec_mask(vec_eq(vec_load(p), vec_splat('*'))) &
+                 vec_mask(vec_eq(vec_load(p + 1), vec_splat('/')));
+
+    if (m)
+      return p + __builtin_ctz(m);
+  }
+#endif
+
+  for (; end - p >= 2; p++) {
+    if (p[0] == '*' && p[1] == '/')
+      return p;
+  }
+
+  return NULL;
+}
+
+/* lex_scan_split(): get the first byte from @p that may start a comment,
+ * a quoted literal or a rule end, or @end.
+ */
+static const char *lex_scan_split (const char *p, const char *end) {
+#ifdef LEX_BLOCK
+  for (; end - p >= LEX_BLOCK; p += LEX_BLOCK) {
+    vec_t v = vec_load(p);
+    uint32_t m = vec_mask(vec_or(vec_or(vec_eq(v, vec_splat('/')),
+                                        vec_eq(v, vec_splat(';'))),
+                                 vec_or(vec_eq(v, vec_splat('\'')),
+                                        vec_eq(v, vec_splat('\"')))));
+
+    if (m)
+      return p + __builtin_ctz(m);
+  }
+#endif
+
+  while (p < end && *p != '/' && *p != ';' && *p != '\'' && *p != '\"')
+    p++;
+
+  return p;
+}
+
+/* lex_is(): get whether the text from @p up to @end equals @str.
+ */
+static int lex_is (const char *p, const char *end, const char *str) {
+  size_t n = strlen(str);
+
+  return ((size_t) (end - p) == n && memcmp(p, str, n) == 0);
+}
+
+/* lex_text(): copy the @n bytes at @p into a new symbol name.
+ */
+static char *lex_text (grammar_t* g, const char *p, size_t n) {
+  char *text = (char*) mem_alloc(g, MEM_SYMBOLS, n + 1);
+
+  if (text) {
+    memcpy(text, p, n);
+    text[n] = '\0';
+  }
+
+  return text;
+}
+
+/* lex_return(): consume the @file up to @p and return the token @tok.
+ */
+static int lex_return (file_t* file, const char *p, int tok) {
+  file->pos = p - file->buf;
+  return tok;
+}
+
+/* ll1_yyerror(): error reporting function called by bison on parse errors.
+ */
+void ll1_yyerror (LL1_YYLTYPE* yylloc, file_t* file, grammar_t* g,
+                  const char *msg) {
+  grammar_fail(g, LL1_EPARSE, "%s:%d: %s", file->name, yylloc->first_line,
+               msg);
+}
+
+/* ll1_yylex(): lexical analysis function that breaks the input grammar file
+ * into a stream of tokens for the bison parser.
+ */
+int ll1_yylex (LL1_YYSTYPE* yylval, LL1_YYLTYPE* yylloc, file_t* file,
+               grammar_t* g) {
+  const char *p = file->buf + file->pos, *end = file->buf + file->len;
+  const char *start, *q;
+  int tok;
+
+  while (1) {
+    p = lex_skip_space(p, end, &yylloc->first_line);
+    if (p == end)
+      return lex_return(file, p, EOF);
+
+    start = p++;
+
+    switch (*start) {
+      case ':': return lex_return(file, p, DERIVES);
+      case ';': return lex_return(file, p, END);
+      case '|': return lex_return(file, p, OR);
+
+      case '/':
+        if (p < end && *p == '/') {
+          q = (const char*) memchr(p, '\n', end - p);
+          p = (q ? q : end);
+        }
+        else if (p < end && *p == '*') {
+          q = lex_comment_end(p, end);
+          q = (q ? q + 2 : end);
+
+          yylloc->first_line += lex_count_lines(p, q);
+          p = q;
+        }
+
+        continue;
+
+      case '\'':
+        if (end - p < 2)
+          return lex_return(file, end, EOF);
+
+        if (p[1] != '\'' && p[0] == '\'') {
+          p++;
+          continue;
+        }
+
+        yylval->id = lex_text(g, p, 1);
+        return lex_return(file, p + 2, yylval->id ? ID : EOF);
+
+      case '\"':
+        q = (const char*) memchr(p, '\"', end - p);
+        if (!q)
+          return lex_return(file, end, EOF);
+
+        yylloc->first_line += lex_count_lines(p, q);
+        yylval->id = lex_text(g, p, q - p);
+        return lex_return(file, q + 1, yylval->id ? ALIAS : EOF);
+    }
+
+    if (!(lex_class[(unsigned char) *start] & LEX_START))
+      continue;
+
+    p = lex_scan_ident(p, end);
+
+    if (*start != '%')
+      tok = ID;
+    else if (lex_is(start, p, STR_EPSILON))
+      tok = EPSILON;
+    else if (lex_is(start, p, STR_TOKEN))
+      return lex_return(file, p, TOKEN);
+    else if (lex_is(start, p, STR_INCLUDE))
+      return lex_return(file, p, INCLUDE);
+    else
+      continue;
+
+    yylval->id = lex_text(g, start, p - start);
+    return lex_return(file, p, yylval->id ? tok : EOF);
+  }
+}
+
+/* grammar_parse(): parse a grammar from the @file text into @g.
+ */
+static int grammar_parse (grammar_t* g, file_t* file) {
+  grammar_phase(g, PHASE_PARSE);
+
+  if (ll1_yyparse(file, g) && !g->status)
+    grammar_fail(g, LL1_EPARSE, "%s: parse failed", file->name);
+
+  return g->status;
+}
+
+/* lex_drop(): free the value @v of the token @tok, if it has one.
+ */
+static void lex_drop (grammar_t* g, int tok, LL1_YYSTYPE *v) {
+  if (tok == ID || tok == EPSILON || tok == ALIAS)
+    mem_free(g, v->id);
+}
+
+/* module_declare(): read the %token and %include directives that open
+ * the module text in @file into @g, and leave @file at its first rule,
+ * or at the first directive that does not parse, for the parser to
+ * report.
+ */
+static int module_declare (grammar_t* g, file_t* file) {
+  LL1_YYSTYPE a, b, c;
+  LL1_YYLTYPE loc;
+  size_t pos = file->pos;
+  int line = file->line;
+
+  loc.first_line = file->line;
+
+  while (!g->status) {
+    pos = file->pos;
+    line = loc.first_line;
+
+    int t1 = ll1_yylex(&a, &loc, file, g);
+    int t2 = (t1 == TOKEN || t1 == INCLUDE ? ll1_yylex(&b, &loc, file, g)
+                                           : 0);
+
+    if (t1 == INCLUDE && t2 == ALIAS) {
+      includes_add(g, b.id);
+      continue;
+    }
+
+    if (t1 == TOKEN && t2 == ID) {
+      size_t pos2 = file->pos;
+      int line2 = loc.first_line;
+      int t3 = ll1_yylex(&c, &loc, file, g);
+
+      if (t3 == ALIAS) {
+        aliases_add(g, b.id, c.id);
+        continue;
+      }
+
+      /* a declaration without an alias ends before the next token. */
+      lex_drop(g, t3, &c);
+      mem_free(g, b.id);
+      file->pos = pos2;
+      loc.first_line = line2;
+      continue;
+    }
+
+    lex_drop(g, t1, &a);
+    lex_drop(g, t2, &b);
+    break;
+  }
+
+  file->pos = pos;
+  file->line = line;
+
+  return g->status;
+}
+
+/* lex_split(): find up to @n offsets in the @file text at which it may be
+ * split into self-contained runs of rules. the first offset follows the
+ * first rule, which also holds every directive, and the others split the
+ * remaining text into roughly equal shares. returns the number of
+ * offsets stored in @cut.
+ */
+static int lex_split (const file_t* file, int n, size_t *cut) {
+  const char *p = file->buf, *end = file->buf + file->len, *q;
+  size_t share = 0, next = 0, last = 0;
+  int k = 0;
+
+  while ((p = lex_scan_split(p, end)) < end) {
+    switch (*p++) {
+      case '/':
+        if (p < end && *p == '/') {
+          q = (const char*) memchr(p, '\n', end - p);
+          p = (q ? q : end);
+        }
+        else if (p < end && *p == '*') {
+          q = lex_comment_end(p, end);
+          p = (q ? q + 2 : end);
+        }
+
+        break;
+
+      case '\'':
+        if (end - p < 2)
+          p = end;
+        else
+          p += (p[1] != '\'' && p[0] == '\'' ? 1 : 2);
+
+        break;
+
+      case '\"':
+        q = (const char*) memchr(p, '\"', end - p);
+        p = (q ? q + 1 : end);
+        break;
+
+      case ';':
+        last = p - file->buf;
+
+        if (k == 0) {
+          share = (file->len - last) / n + 1;
+          next = last + share;
+          cut[k++] = last;
+        }
+        else if (k < n && last >= next) {
+          next = last + share;
+          cut[k++] = last;
+        }
+
+        break;
+    }
+  }
+
+  /* text after the last offset must hold at least one rule. */
+  if (k && cut[k - 1] == last)
+    k--;
+
+  return k;
+}
+
+/* grammar_inherit(): initialize @c for parsing part of the grammar @g
+ * on its own, with the threads of @g, every alias declared so far, and
+ * the memory budget of @g, which they share.
+ */
+static void grammar_inherit (grammar_t* g, grammar_t* c) {
+  grammar_init(c);
+  mem_set_limit(c, g->mem.limit);
+  c->mem.shared = g->mem.shared;
+  c->threads = g->threads;
+
+  for (int j = 0; j < g->alias_count && !c->status; j++)
+    aliases_add(c, mem_strdup(c, MEM_SYMBOLS, g->aliases[j].from),
+                mem_strdup(c, MEM_SYMBOLS, g->aliases[j].to));
+}
+
+/* grammar_merge(): append the symbols and productions parsed into the
+ * grammar @c to @g, renumbering the symbols of @c as if they had been
+ * parsed into @g directly, along with the aliases declared in @c past
+ * those it inherited from @g and the modules that @c includes.
+ */
+static int grammar_merge (grammar_t* g, grammar_t* c) {
+  int *map = (int*) mem_alloc(g, MEM_TEMP, (c->n_symbols + 1) * sizeof(int));
+
+  for (int i = 0; i < c->n_symbols && !g->status; i++) {
+    char *name = mem_strdup(g, MEM_SYMBOLS, c->symbols[i].name);
+    if (name)
+      map[i] = symbols_add(g, name, bits_test(c->sym_terminal, i));
+  }
+
+  for (int i = 0; i < c->n_prods && !g->status; i++) {
+    const int *src = c->rhs + c->prod_off[i];
+    int n = c->prod_len[i];
+
+    int *rhs = prods_append(g, map[c->prod_lhs[i] - 1], n);
+    if (!rhs)
+      break;
+
+    for (int j = 0; j < n; j++)
+      rhs[j] = map[src[j] - 1];
+  }
+
+  for (int i = g->alias_count; i < c->alias_count && !g->status; i++)
+    aliases_add(g, mem_strdup(g, MEM_SYMBOLS, c->aliases[i].from),
+                mem_strdup(g, MEM_SYMBOLS, c->aliases[i].to));
+
+  for (int i = 0; i < c->n_includes && !g->status; i++)
+    includes_add(g, mem_strdup(g, MEM_SYMBOLS, c->includes[i]));
+
+  mem_free(g, map);
+  return g->status;
+}
+
+/* data structure for holding one run of rules parsed on its own thread.
+ */
+struct chunk {
+  grammar_t g;
+  file_t file;
+  pthread_t thread;
+  int started;
+};
+
+/* chunk_parse(): thread function parsing a run of rules.
+ */
+static void *chunk_parse (void *arg) {
+  struct chunk *c = (struct chunk*) arg;
+
+  grammar_parse(&c->g, &c->file);
+  return NULL;
+}
+
+/* grammar_parse_split(): parse the @file text into @g, splitting its
+ * rules into up to @n runs that are parsed concurrently. the first rule
+ * is parsed beforehand, so every run sees the aliases declared before
+ * it, and the runs are merged in order so that symbols are numbered as
+ * by a single parse.
+ */
+static int grammar_parse_split (grammar_t* g, file_t* file, int n) {
+  size_t *cut = (size_t*) mem_alloc(g, MEM_TEMP, (n + 1) * sizeof(size_t));
+  struct chunk *chunks = (struct chunk*)
+    mem_alloc(g, MEM_TEMP, (n + 1) * sizeof(struct chunk));
+
+  int k = (g->status ? 0 : lex_split(file, n, cut));
+
+  if (k < 2) {
+    mem_free(g, cut);
+    mem_free(g, chunks);
+    return (g->status ? g->status : grammar_parse(g, file));
+  }
+
+  cut[k] = file->len;
+
+  file_t first = *file;
+  first.len = cut[0];
+
+  if (grammar_parse(g, &first)) {
+    mem_free(g, cut);
+    mem_free(g, chunks);
+    return g->status;
+  }
+
+  int line = file->line + lex_count_lines(file->buf, file->buf + cut[0]);
+
+  /* the runs are held to the memory budget of @g, along with it. */
+  struct mem_shared shared;
+  mem_share_begin(g, &shared);
+
+  for (int i = 0; i < k; i++) {
+    struct chunk *c = chunks + i;
+
+    grammar_inherit(g, &c->g);
+
+    c->file = *file;
+    c->file.buf = file->buf + cut[i];
+    c->file.len = cut[i + 1] - cut[i];
+    c->file.line = line;
+    line += lex_count_lines(c->file.buf, c->file.buf + c->file.len);
+
+    c->started = (!c->g.status &&
+                  pthread_create(&c->thread, NULL, chunk_parse, c) == 0);
+  }
+
+  for (int i = 0; i < k; i++) {
+    struct chunk *c = chunks + i;
+
+    if (c->started)
+      pthread_join(c->thread, NULL);
+    else if (!c->g.status)
+      chunk_parse(c);
+  }
+
+  for (int i = 0; i < k; i++) {
+    struct chunk *c = chunks + i;
+
+    if (c->g.status)
+      grammar_fail(g, c->g.status, "%s", c->g.errmsg);
+    else if (!g->status)
+      grammar_merge(g, &c->g);
+
+    grammar_free(&c->g);
+  }
+
+  mem_share_end(g);
+
+  mem_free(g, cut);
+  mem_free(g, chunks);
+
+  return g->status;
+}
+
+/* grammar_parse_text(): parse the @file text into @g, on as many threads
+ * as the grammar allows or, by default, as the size of the text merits.
+ */
+static int grammar_parse_text (grammar_t* g, file_t* file) {
+  int n = g->threads;
+
+  if (n == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    n = (int) (file->len / PARSE_CHUNK_MIN);
+    if (cpus > 0 && n > cpus)
+      n = (int) cpus;
+  }
+
+  if (n > PARSE_THREADS_MAX)
+    n = PARSE_THREADS_MAX;
+
+  if (n > 1)
+    return grammar_parse_split(g, file, n);
+
+  return grammar_parse(g, file);
+}
+
+/* module_key(): hash the @len bytes of module text at @buf, along with
+ * the aliases of @g in scope when it is parsed, which decide the symbols
+ * that its quoted literals stand for.
+ */
+static uint64_t module_key (grammar_t* g, const char *buf, size_t len) {
+  uint64_t h = 14695981039346656037ull;
+
+  for (size_t i = 0; i < len; i++)
+    h = (h ^ (unsigned char) buf[i]) * 1099511628211ull;
+
+  for (int i = 0; i < g->alias_count; i++) {
+    const char *s[2] = { g->aliases[i].from, g->aliases[i].to };
+
+    for (int j = 0; j < 2; j++) {
+      do
+        h = (h ^ (unsigned char) *s[j]) * 1099511628211ull;
+      while (*s[j]++);
+    }
+  }
+
+  return h;
+}
+
+/* module_slot(): hash the @name of a module into the name of its image
+ * in the cache directory. every module has one image, which is replaced
+ * whenever its key changes, so the cache holds no stale images.
+ */
+static uint64_t module_slot (const char *name) {
+  uint64_t h = 14695981039346656037ull;
+
+  do
+    h = (h ^ (unsigned char) *name) * 1099511628211ull;
+  while (*name++);
+
+  return h;
+}
+
+/* module_parse(): parse the rules of the @len bytes of module text at
+ * @buf, named @name, into @g. the rules start at offset @body, on line
+ * @line, past the directives read by module_declare(). if @g has a cache
+ * directory, the module is parsed on its own, or read back from the cache
+ * when neither its text nor the aliases in scope have changed, and merged
+ * into @g.
+ */
+static int module_parse (grammar_t* g, const char *name, const char *buf,
+                         size_t len, size_t body, int line) {
+  file_t file = {
+    .buf = buf + body,
+    .pos = 0,
+    .len = len - body,
+    .name = (char*) name,
+    .line = line
+  };
+
+  if (!g->cache_dir)
+    return grammar_parse_text(g, &file);
+
+  uint64_t key = module_key(g, buf, len);
+  size_t n = strlen(g->cache_dir) + 32;
+  char *path = (char*) mem_alloc(g, MEM_TEMP, n);
+  if (!path)
+    return g->status;
+
+  snprintf(path, n, "%s/%016" PRIx64 ".ll1m", g->cache_dir,
+           module_slot(name));
+
+  struct mem_shared shared;
+  mem_share_begin(g, &shared);
+
+  grammar_t m;
+  int inherited = g->alias_count;
+  grammar_inherit(g, &m);
+
+  int cached = (!m.status && !compiled_load_module(&m, path, key));
+
+  if (!cached) {
+    grammar_free(&m);
+    grammar_inherit(g, &m);
+    grammar_parse_text(&m, &file);
+  }
+
+  if (m.status)
+    grammar_fail(g, m.status, "%s", m.errmsg);
+  else
+    grammar_merge(g, &m);
+
+  /* failing to fill the cache only costs a parse on the next run. */
+  if (!cached && !m.status) {
+    mkdir(g->cache_dir, 0777);
+    compiled_write_module(&m, path, key, inherited);
+  }
+
+  grammar_free(&m);
+  mem_share_end(g);
+
+  mem_free(g, path);
+
+  return g->status;
+}
+
+/* module_map(): map the module file named @fname into memory, storing
+ * its address in @base and its length in @size. an empty file maps to
+ * a NULL @base.
+ */
+static int module_map (grammar_t* g, const char *fname, void **base,
+                       size_t *size) {
+  struct stat st;
+
+  int fd = open(fname, O_RDONLY);
+  if (fd < 0)
+    return grammar_fail(g, LL1_EIO, "%s: %s", fname, strerror(errno));
+
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return grammar_fail(g, LL1_EIO, "%s: %s", fname, strerror(errno));
+  }
+
+  *size = st.st_size;
+  *base = (*size ? mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0)
+                 : NULL);
+  close(fd);
+
+  if (*base == MAP_FAILED)
+    return grammar_fail(g, LL1_EIO, "%s: %s", fname, strerror(errno));
+
+  return LL1_OK;
+}
+
+/* data structure for holding a module of a grammar: the @path that it
+ * is read from, the @dev and @ino of the file, under which every module
+ * is parsed only once, and the offset and line of its rules (@body and
+ * @line), past its directives.
+ */
+struct module {
+  char *path;
+  dev_t dev;
+  ino_t ino;
+
+  size_t body;
+  int line;
+};
+
+/* data structure for holding the @n modules of a grammar (of @cap
+ * allocated) in the order they are parsed.
+ */
+struct modules {
+  struct module *mod;
+  int n, cap;
+};
+
+/* modules_free(): deallocate the module list @mods.
+ */
+static void modules_free (grammar_t* g, struct modules *mods) {
+  for (int i = 0; i < mods->n; i++)
+    mem_free(g, mods->mod[i].path);
+
+  mem_free(g, mods->mod);
+}
+
+/* modules_add(): append the module @name to @mods, unless it is there
+ * already. a relative @name is taken from the directory of the module
+ * named @from that includes it, if any.
+ */
+static int modules_add (grammar_t* g, struct modules *mods,
+                        const char *from, const char *name) {
+  const char *slash = (from && *name != '/' ? strrchr(from, '/') : NULL);
+  size_t dir = (slash ? (size_t) (slash - from) + 1 : 0);
+  struct stat st;
+
+  char *path = (char*) mem_alloc(g, MEM_TEMP, dir + strlen(name) + 1);
+  if (!path)
+    return g->status;
+
+  if (dir)
+    memcpy(path, from, dir);
+
+  strcpy(path + dir, name);
+
+  if (stat(path, &st) != 0) {
+    if (from)
+      grammar_fail(g, LL1_EIO, "%s: %s: %s", from, path, strerror(errno));
+    else
+      grammar_fail(g, LL1_EIO, "%s: %s", path, strerror(errno));
+
+    mem_free(g, path);
+    return g->status;
+  }
+
+  for (int i = 0; i < mods->n; i++) {
+    if (mods->mod[i].dev == st.st_dev && mods->mod[i].ino == st.st_ino) {
+      mem_free(g, path);
+      return LL1_OK;
+    }
+  }
+
+  if (mods->n == mods->cap) {
+    int cap = (mods->cap ? 2 * mods->cap : 8);
+    struct module *mnew = (struct module*)
+      mem_realloc(g, MEM_TEMP, mods->mod, cap * sizeof(struct module));
+
+    if (!mnew) {
+      mem_free(g, path);
+      return g->status;
+    }
+
+    mods->mod = mnew;
+    mods->cap = cap;
+  }
+
+  struct module *m = mods->mod + mods->n++;
+  m->path = path;
+  m->dev = st.st_dev;
+  m->ino = st.st_ino;
+
+  return LL1_OK;
+}
+
+/* modules_include(): add the modules included by the module named @from
+ * to @mods, from index @k of the include list of @g.
+ */
+static int modules_include (grammar_t* g, struct modules *mods,
+                            const char *from, int k) {
+  for (; k < g->n_includes && !g->status; k++)
+    modules_add(g, mods, from, g->includes[k]);
+
+  return g->status;
+}
+
+/* modules_declare(): read the directives of every module of @mods into
+ * @g, in order, adding the modules that each one includes to the end of
+ * @mods.
+ */
+static int modules_declare (grammar_t* g, struct modules *mods) {
+  for (int i = 0; i < mods->n && !g->status; i++) {
+    struct module *m = mods->mod + i;
+    int k = g->n_includes;
+    size_t size;
+    void *base;
+
+    if (module_map(g, m->path, &base, &size))
+      break;
+
+    file_t file = {
+      .buf = (const char*) base,
+      .pos = 0,
+      .len = size,
+      .name = m->path,
+      .line = 1
+    };
+
+    module_declare(g, &file);
+    m->body = file.pos;
+    m->line = file.line;
+
+    if (base)
+      munmap(base, size);
+
+    modules_include(g, mods, m->path, k);
+  }
+
+  return g->status;
+}
+
+/* modules_parse(): parse the rules of every module of @mods into @g, in
+ * order.
+ */
+static int modules_parse (grammar_t* g, struct modules *mods) {
+  for (int i = 0; i < mods->n && !g->status; i++) {
+    struct module *m = mods->mod + i;
+    size_t size;
+    void *base;
+
+    if (module_map(g, m->path, &base, &size))
+      break;
+
+    /* a module cut short since its directives were read is parsed whole. */
+    if (m->body > size)
+      m->body = 0, m->line = 1;
+
+    module_parse(g, m->path, (const char*) base, size, m->body, m->line);
+
+    if (base)
+      munmap(base, size);
+  }
+
+  return g->status;
+}
+
+/* grammar_parse_files(): parse the @n grammar files named in @fnames
+ * into @g, as modules sharing one symbol table. the directives of every
+ * module are read first, so that the rules of each module see the aliases
+ * declared by all of them. every module included by another is parsed
+ * after the modules named before it, so that the first rule of the first
+ * file remains the start rule.
+ */
+int grammar_parse_files (grammar_t* g, int n, char **fnames) {
+  struct modules mods = { NULL, 0, 0 };
+
+  grammar_phase(g, PHASE_PARSE);
+
+  for (int i = 0; i < n && !g->status; i++)
+    modules_add(g, &mods, NULL, fnames[i]);
+
+  if (!modules_declare(g, &mods))
+    modules_parse(g, &mods);
+
+  modules_free(g, &mods);
+
+  if (!g->status && !g->n_prods)
+    grammar_fail(g, LL1_EPARSE, "%s: no rules", n ? fnames[0] : "grammar");
+
+  return g->status;
+}
+
+/* grammar_parse_file(): parse the grammar file named @fname, and every
+ * module that it includes, into @g.
+ */
+int grammar_parse_file (grammar_t* g, const char *fname) {
+  char *name = (char*) fname;
+
+  return grammar_parse_files(g, 1, &name);
+}
+
+/* grammar_parse_buffer(): parse a grammar held in the @len bytes of @buf,
+ * and every module that it includes, into @g. the @name is used in error
+ * messages, and relative includes are taken from its directory.
+ */
+int grammar_parse_buffer (grammar_t* g, const char *name,
+                          const char *buf, size_t len) {
+  struct modules mods = { NULL, 0, 0 };
+  int k = g->n_includes;
+
+  file_t file = {
+    .buf = buf,
+    .pos = 0,
+    .len = len,
+    .name = (char*) name,
+    .line = 1
+  };
+
+  grammar_phase(g, PHASE_PARSE);
+
+  if (!module_declare(g, &file) &&
+      !modules_include(g, &mods, name, k) &&
+      !modules_declare(g, &mods) &&
+      !module_parse(g, name, buf, len, file.pos, file.line))
+    modules_parse(g, &mods);
+
+  modules_free(g, &mods);
+
+  if (!g->status && !g->n_prods)
+    grammar_fail(g, LL1_EPARSE, "%s: no rules", name);
+
+  return g->status;
+}
@@ -10,10 +10,12 @@
 %debug
 
 %define api.pure full
+%define api.prefix {ll1_yy}
 %locations
 
-%lex-param {file_t file}
-%parse-param {file_t file}
+%lex-param {file_t* file}
+%lex-param {grammar_t* g}
+%parse-param {file_t* file}
 %parse-param {grammar_t* g}
 
 %code requires {
@@ -27,10 +29,18 @@
 #include "grammar.h"
 
 /* pre-declare functions used by yyparse(). */
-void yyerror (YYLTYPE* yylloc, file_t file, grammar_t* g, const char *msg);
-int yylex (YYSTYPE* yylval, YYLTYPE* yylloc, file_t file);
+void ll1_yyerror (LL1_YYLTYPE* yylloc, file_t* file, grammar_t* g,
+                  const char *msg);
+int ll1_yylex (LL1_YYSTYPE* yylval, LL1_YYLTYPE* yylloc, file_t* file,
+               grammar_t* g);
+
+/* abort parsing as soon as a semantic action records a failure. */
+#define CHECK_STATUS() if (g->status) YYABORT
 %}
 
+/* number lines from the start of the text being parsed. */
+%initial-action { @$.first_line = @$.last_line = file->line; }
+
 /* define the data structure used for passing attributes with symbols
  * in the parsed grammar.
  */
@@ -46,7 +56,7 @@ int yylex (YYSTYPE* yylval, YYLTYPE* yylloc, file_t file);
 
 /* define the set of terminal symbols to parse. */
 %token TOKEN EPSILON
-%token ID DERIVES END OR ALIAS
+%token ID DERIVES END OR ALIAS INCLUDE
 
 /* set up attribute types of nonterminals. */
 %type<sym> symbol
@@ -59,7 +69,7 @@ int yylex (YYSTYPE* yylval, YYLTYPE* yylloc, file_t file);
 %%
 
 grammar
-  : opt_preamble rules
+  : opt_preamble opt_rules
   ;
 
 opt_preamble
@@ -77,20 +87,27 @@ directive_list
 
 directive
   : TOKEN ID ALIAS
-  { aliases_add(g, $ID, $ALIAS); }
+  { aliases_add(g, $ID, $ALIAS); CHECK_STATUS(); }
   | TOKEN ID
+  { mem_free(g, $ID); }
+  | INCLUDE ALIAS
+  { includes_add(g, $ALIAS); CHECK_STATUS(); }
   ;
 
+/* a module may hold nothing but directives, such as includes. */
+opt_rules : %empty | rules ;
+
 rules : rules rule | rule ;
 
-rule : ID DERIVES productions END { prods_add(g, symbols_add(g, $1, 0), $3); };
+rule : ID DERIVES productions END
+     { prods_add(g, symbols_add(g, $1, 0), $3); CHECK_STATUS(); };
 
-productions : productions OR symbols { $$ = symvv_add($1, $3); }
-            | symbols                { $$ = symvv_new($1);     };
+productions : productions OR symbols { $$ = symvv_add(g, $1, $3); CHECK_STATUS(); }
+            | symbols                { $$ = symvv_new(g, $1);     CHECK_STATUS(); };
 
-symbols : symbols symbol { $$ = symv_add($1, $2); }
-        | symbol         { $$ = symv_new($1);     };
+symbols : symbols symbol { $$ = symv_add(g, $1, $2); CHECK_STATUS(); }
+        | symbol         { $$ = symv_new(g, $1);     CHECK_STATUS(); };
 
-symbol : ID      { $$ = symbols_add(g, $1, 1); }
-       | EPSILON { $$ = symbols_add(g, $1, 1); }
-       | ALIAS   { $$ = symbols_add(g, aliased_from(g, $1), 1); };
+symbol : ID      { $$ = symbols_add(g, $1, 1); CHECK_STATUS(); }
+       | EPSILON { $$ = symbols_add(g, $1, 1); CHECK_STATUS(); }
+       | ALIAS   { $$ = symbols_add(g, aliased_from(g, $1), 1); CHECK_STATUS(); };
@@ -0,0 +1,937 @@
+#include "lr.h"
+#include "engine.h"
+#include "bitset.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* the lr(0) automaton is built over items that are simply positions in
+ * the shared right-hand side store: an item sits on the symbol at its
+ * position, and reaches the end of its production at the terminator.
+ * the two items of the augmented start production lie just past the
+ * store. items never sit on epsilon, which is skipped over. lookaheads
+ * are then computed with the relations of DeRemer and Pennello, solved
+ * by the digraph algorithm shared with the optimized engine, over sets
+ * holding one bit per terminal and a last bit for the end of input.
+ */
+
+/* data structure for holding a growable array of @n integers, of @cap
+ * allocated in the memory class @cls.
+ */
+struct vec {
+  int *v, n, cap, cls;
+};
+
+/* data structure for holding a set of lists of integers, stored back to
+ * back in @v from the offsets @start, and found by their contents through
+ * the hash @table of @cap slots.
+ */
+struct lists {
+  struct vec v, start;
+  int *table, cap;
+};
+
+/* data structure for holding the state of the automaton construction:
+ * the growing arrays of the automaton, its @states by their kernels, the
+ * productions of each nonterminal (@alts), the closure @stamp last given
+ * to each nonterminal (@seen), the sorted (symbol, item) @pairs of the
+ * current state and the nonterminals its kernel sits on (@nts). @work,
+ * @items and @merged are scratch arrays.
+ */
+struct lr_work {
+  grammar_t *g;
+
+  struct lists states;
+  struct vec trans_start, trans_sym, trans_to, red_start, red_prod;
+  struct vec pairs, nts, work, items, merged;
+
+  struct relation alts;
+  int *seen, stamp;
+
+  /* sorted pairs of the closure over each list of nonterminals in
+   * @closures, kept in @cache from the offsets @cache_start, until
+   * @cache_max entries are held.
+   */
+  struct lists closures;
+  struct vec cache, cache_start;
+  int cache_max;
+
+  /* one-based index of the epsilon symbol, or zero. */
+  int eps;
+};
+
+/* vec_push(): append the value @x to the array @a.
+ */
+static int vec_push (grammar_t* g, struct vec *a, int x) {
+  if (a->n == a->cap) {
+    int cap = (a->cap ? 2 * a->cap : 64);
+    int *v = (int*) mem_realloc(g, a->cls, a->v, cap * sizeof(int));
+
+    if (!v)
+      return g->status;
+
+    a->v = v;
+    a->cap = cap;
+  }
+
+  a->v[a->n++] = x;
+  return LL1_OK;
+}
+
+/* item_aug(): get the first item of the augmented start production,
+ * which sits on the start symbol. the item after it is its end.
+ */
+static int item_aug (grammar_t* g) {
+  return g->n_rhs;
+}
+
+/* item_sym(): get the symbol that the item @it sits on, or zero if the
+ * item is at the end of its production.
+ */
+static int item_sym (grammar_t* g, int it) {
+  if (it == item_aug(g))
+    return g->prod_lhs[0];
+
+  if (it > item_aug(g))
+    return 0;
+
+  return g->rhs[it];
+}
+
+/* item_norm(): advance the item @it past any epsilon symbols.
+ */
+static int item_norm (grammar_t* g, int eps, int it) {
+  while (it < g->n_rhs && eps && g->rhs[it] == eps)
+    it++;
+
+  return it;
+}
+
+/* item_next(): get the item following the item @it, which must not be
+ * at the end of its production.
+ */
+static int item_next (grammar_t* g, int eps, int it) {
+  if (it == item_aug(g))
+    return it + 1;
+
+  return item_norm(g, eps, it + 1);
+}
+
+/* item_prod(): get the production holding the item @it, found from the
+ * ordered offsets of the right-hand sides.
+ */
+static int item_prod (grammar_t* g, int it) {
+  int lo = 0, hi = g->n_prods - 1;
+
+  while (lo < hi) {
+    int mid = (lo + hi + 1) / 2;
+
+    if (g->prod_off[mid] <= it)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+
+  return lo;
+}
+
+/* lr_find(): get the index of the transition of state @s on the symbol
+ * @sym, or -1 if there is none.
+ */
+static int lr_find (struct lr *a, int s, int sym) {
+  int lo = a->trans_start[s], hi = a->trans_start[s + 1] - 1;
+
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+
+    if (a->trans_sym[mid] == sym)
+      return mid;
+    else if (a->trans_sym[mid] < sym)
+      lo = mid + 1;
+    else
+      hi = mid - 1;
+  }
+
+  return -1;
+}
+
+/* list_hash(): hash the @n integers of a list.
+ */
+static unsigned int list_hash (const int *x, int n) {
+  unsigned int h = 2166136261u;
+
+  for (int i = 0; i < n; i++)
+    h = (h ^ (unsigned int) x[i]) * 16777619u;
+
+  return h ^ (h >> 15);
+}
+
+/* lists_rehash(): grow the hash table of @l if it has no room for one
+ * more list.
+ */
+static int lists_rehash (grammar_t* g, struct lists *l) {
+  int n = l->start.n - 1, cap = (l->cap ? 2 * l->cap : 256);
+
+  if (2 * (n + 1) < l->cap)
+    return LL1_OK;
+
+  int *table = (int*) mem_alloc(g, MEM_TEMP, cap * sizeof(int));
+  if (!table)
+    return g->status;
+
+  memset(table, -1, cap * sizeof(int));
+
+  for (int i = 0; i < n; i++) {
+    const int *x = l->v.v + l->start.v[i];
+    unsigned int h = list_hash(x, l->start.v[i + 1] - l->start.v[i]);
+
+    for (h &= cap - 1; table[h] >= 0; h = (h + 1) & (cap - 1));
+    table[h] = i;
+  }
+
+  mem_free(g, l->table);
+  l->table = table;
+  l->cap = cap;
+
+  return LL1_OK;
+}
+
+/* lists_find(): get the index of the list of the @n integers @x in @l,
+ * adding it if it is new and @add is set. returns -1 if the list is not
+ * found.
+ */
+static int lists_find (grammar_t* g, struct lists *l, const int *x, int n,
+                       bool add) {
+  if (lists_rehash(g, l))
+    return -1;
+
+  unsigned int h = list_hash(x, n) & (l->cap - 1);
+
+  for (; l->table[h] >= 0; h = (h + 1) & (l->cap - 1)) {
+    int i = l->table[h], off = l->start.v[i];
+
+    if (l->start.v[i + 1] - off == n &&
+        memcmp(l->v.v + off, x, n * sizeof(int)) == 0)
+      return i;
+  }
+
+  if (!add)
+    return -1;
+
+  for (int i = 0; i < n; i++)
+    vec_push(g, &l->v, x[i]);
+
+  vec_push(g, &l->start, l->v.n);
+  if (g->status)
+    return -1;
+
+  l->table[h] = l->start.n - 2;
+  return l->start.n - 2;
+}
+
+/* int_cmp(): order integers.
+ */
+static int int_cmp (const void *pa, const void *pb) {
+  int a = *(const int*) pa, b = *(const int*) pb;
+
+  return (a > b) - (a < b);
+}
+
+/* pair_cmp(): order (symbol, item) pairs by symbol, then by item.
+ */
+static int pair_cmp (const void *pa, const void *pb) {
+  const int *a = (const int*) pa, *b = (const int*) pb;
+
+  if (a[0] != b[0])
+    return (a[0] < b[0] ? -1 : 1);
+
+  return (a[1] > b[1]) - (a[1] < b[1]);
+}
+
+/* lr_close(): append to @out the (symbol, item) pairs of the items
+ * added by the closure over the @n nonterminals @nts, given by dense
+ * index, along with a (0, production) pair for each complete item.
+ */
+static void lr_close (struct lr_work *w, const int *nts, int n,
+                      struct vec *out) {
+  grammar_t *g = w->g;
+
+  w->stamp++;
+  w->work.n = 0;
+
+  for (int i = 0; i < n; i++) {
+    if (w->seen[nts[i]] != w->stamp) {
+      w->seen[nts[i]] = w->stamp;
+      vec_push(g, &w->work, nts[i]);
+    }
+  }
+
+  for (int c = 0; c < w->work.n && !g->status; c++) {
+    int d = w->work.v[c];
+
+    for (int j = w->alts.start[d]; j < w->alts.start[d + 1]; j++) {
+      int p = w->alts.adj[j];
+      int it = item_norm(g, w->eps, g->prod_off[p]), sym = item_sym(g, it);
+
+      if (sym == 0) {
+        vec_push(g, out, 0);
+        vec_push(g, out, p);
+        continue;
+      }
+
+      vec_push(g, out, sym);
+      vec_push(g, out, item_next(g, w->eps, it));
+
+      if (bits_test(g->sym_terminal, sym - 1) ||
+          w->seen[g->dense[sym - 1]] == w->stamp)
+        continue;
+
+      w->seen[g->dense[sym - 1]] = w->stamp;
+      vec_push(g, &w->work, g->dense[sym - 1]);
+    }
+  }
+}
+
+/* lr_cached(): get the index of the sorted closure pairs over the
+ * nonterminals @nts in the cache, computing them on first use. returns
+ * -1 if they are not cached and the cache is full.
+ */
+static int lr_cached (struct lr_work *w) {
+  grammar_t *g = w->g;
+  bool add = (w->cache.n <= w->cache_max);
+  int c = lists_find(g, &w->closures, w->nts.v, w->nts.n, add);
+
+  if (c < 0 || c < w->cache_start.n - 1)
+    return c;
+
+  int start = w->cache.n;
+  lr_close(w, w->nts.v, w->nts.n, &w->cache);
+  vec_push(g, &w->cache_start, w->cache.n);
+
+  if (g->status)
+    return -1;
+
+  qsort(w->cache.v + start, (w->cache.n - start) / 2, 2 * sizeof(int),
+        pair_cmp);
+
+  return c;
+}
+
+/* lr_merge(): merge the sorted pairs of the current state with the
+ * cached closure pairs of index @c.
+ */
+static void lr_merge (struct lr_work *w, int c) {
+  grammar_t *g = w->g;
+  const int *b = w->cache.v + w->cache_start.v[c];
+  int i = 0, j = 0, nb = w->cache_start.v[c + 1] - w->cache_start.v[c];
+
+  w->merged.n = 0;
+
+  while ((i < w->pairs.n || j < nb) && !g->status) {
+    const int *x;
+
+    if (j >= nb || (i < w->pairs.n && pair_cmp(w->pairs.v + i, b + j) < 0))
+      x = w->pairs.v + i, i += 2;
+    else
+      x = b + j, j += 2;
+
+    vec_push(g, &w->merged, x[0]);
+    vec_push(g, &w->merged, x[1]);
+  }
+
+  struct vec t = w->pairs;
+  w->pairs = w->merged;
+  w->merged = t;
+}
+
+/* lr_expand(): compute the closure of state @s, recording its
+ * reductions and adding the states reached by its transitions. the
+ * closure over the nonterminals that the kernel sits on is shared by
+ * all states sitting on the same ones, and merged in already sorted.
+ */
+static int lr_expand (struct lr_work *w, int s) {
+  grammar_t *g = w->g;
+  const int *start = w->states.start.v;
+
+  if (work_step(g, 0))
+    return g->status;
+
+  w->pairs.n = w->nts.n = 0;
+  w->stamp++;
+
+  for (int k = start[s]; k < start[s + 1]; k++) {
+    int it = w->states.v.v[k], sym = item_sym(g, it);
+
+    if (sym == 0) {
+      if (it != item_aug(g) + 1) {
+        vec_push(g, &w->pairs, 0);
+        vec_push(g, &w->pairs, item_prod(g, it));
+      }
+
+      continue;
+    }
+
+    vec_push(g, &w->pairs, sym);
+    vec_push(g, &w->pairs, item_next(g, w->eps, it));
+
+    int d = g->dense[sym - 1];
+    if (!bits_test(g->sym_terminal, sym - 1) && w->seen[d] != w->stamp) {
+      w->seen[d] = w->stamp;
+      vec_push(g, &w->nts, d);
+    }
+  }
+
+  if (g->status)
+    return g->status;
+
+  qsort(w->nts.v, w->nts.n, sizeof(int), int_cmp);
+  int c = (w->nts.n ? lr_cached(w) : -1);
+
+  if (c >= 0) {
+    qsort(w->pairs.v, w->pairs.n / 2, 2 * sizeof(int), pair_cmp);
+    lr_merge(w, c);
+  }
+  else {
+    lr_close(w, w->nts.v, w->nts.n, &w->pairs);
+    qsort(w->pairs.v, w->pairs.n / 2, 2 * sizeof(int), pair_cmp);
+  }
+
+  int i = 0;
+  for (; i < w->pairs.n && w->pairs.v[i] == 0; i += 2) {
+    if (i == 0 || w->pairs.v[i + 1] != w->pairs.v[i - 1])
+      vec_push(g, &w->red_prod, w->pairs.v[i + 1]);
+  }
+
+  vec_push(g, &w->red_start, w->red_prod.n);
+
+  /* the items reached on each symbol are gathered as the kernel of the
+   * next state.
+   */
+  while (i < w->pairs.n && !g->status) {
+    int sym = w->pairs.v[i];
+
+    w->items.n = 0;
+    for (; i < w->pairs.n && w->pairs.v[i] == sym; i += 2) {
+      if (w->items.n == 0 || w->pairs.v[i + 1] != w->pairs.v[i - 1])
+        vec_push(g, &w->items, w->pairs.v[i + 1]);
+    }
+
+    int t = lists_find(g, &w->states, w->items.v, w->items.n, true);
+    vec_push(g, &w->trans_sym, sym);
+    vec_push(g, &w->trans_to, t);
+  }
+
+  vec_push(g, &w->trans_start, w->trans_sym.n);
+  return g->status;
+}
+
+/* lr_automaton(): build the lr(0) states of the grammar into @a, giving
+ * up once more than @max_states states are found, or more kernel items
+ * or transitions than LR_SIZE_PER_STATE for each of them.
+ */
+static int lr_automaton (grammar_t* g, struct lr *a, int max_states) {
+  long max_size = (long) max_states * LR_SIZE_PER_STATE;
+  struct lr_work w;
+  int *src, *dst;
+
+  memset(&w, 0, sizeof(w));
+  w.g = g;
+  w.states.v.cls = w.states.start.cls = MEM_LR;
+  w.trans_start.cls = w.trans_sym.cls = w.trans_to.cls = MEM_LR;
+  w.red_start.cls = w.red_prod.cls = MEM_LR;
+  w.pairs.cls = w.nts.cls = w.work.cls = MEM_TEMP;
+  w.items.cls = w.merged.cls = MEM_TEMP;
+  w.closures.v.cls = w.closures.start.cls = MEM_TEMP;
+  w.cache.cls = w.cache_start.cls = MEM_TEMP;
+
+  int eps = epsilon_index(g);
+  w.eps = (eps >= 0 ? g->terms[eps] : 0);
+  w.cache_max = 4 * (g->n_rhs + 1024);
+
+  w.seen = (int*) mem_alloc(g, MEM_TEMP, (g->n_nonterms + 1) * sizeof(int));
+  src = (int*) mem_alloc(g, MEM_TEMP, (g->n_prods + 1) * sizeof(int));
+  dst = (int*) mem_alloc(g, MEM_TEMP, (g->n_prods + 1) * sizeof(int));
+
+  if (!g->status) {
+    memset(w.seen, 0, (g->n_nonterms + 1) * sizeof(int));
+
+    for (int p = 0; p < g->n_prods; p++) {
+      src[p] = g->dense[g->prod_lhs[p] - 1];
+      dst[p] = p;
+    }
+
+    relation_build(g, &w.alts, g->n_nonterms, g->n_prods, src, dst);
+  }
+
+  int aug = item_aug(g);
+  vec_push(g, &w.states.start, 0);
+  vec_push(g, &w.closures.start, 0);
+  vec_push(g, &w.cache_start, 0);
+  vec_push(g, &w.trans_start, 0);
+  vec_push(g, &w.red_start, 0);
+
+  if (!g->status)
+    lists_find(g, &w.states, &aug, 1, true);
+
+  for (int s = 0; s < w.states.start.n - 1 && !g->status; s++) {
+    if (w.states.start.n - 1 > max_states || w.states.v.n > max_size ||
+        w.trans_sym.n > max_size) {
+      a->truncated = true;
+      break;
+    }
+
+    lr_expand(&w, s);
+  }
+
+  a->n_states = (w.states.start.n ? w.states.start.n - 1 : 0);
+  a->kern = w.states.v.v;
+  a->kern_start = w.states.start.v;
+  a->trans_start = w.trans_start.v;
+  a->trans_sym = w.trans_sym.v;
+  a->trans_to = w.trans_to.v;
+  a->red_start = w.red_start.v;
+  a->red_prod = w.red_prod.v;
+
+  if (!g->status && !a->truncated) {
+    int k = lr_find(a, 0, g->prod_lhs[0]);
+    a->accept = (k >= 0 ? a->trans_to[k] : -1);
+  }
+
+  relation_free(g, &w.alts);
+  mem_free(g, w.seen);
+  mem_free(g, w.states.table);
+  mem_free(g, w.pairs.v);
+  mem_free(g, w.nts.v);
+  mem_free(g, w.work.v);
+  mem_free(g, w.items.v);
+  mem_free(g, w.merged.v);
+  mem_free(g, w.closures.v.v);
+  mem_free(g, w.closures.start.v);
+  mem_free(g, w.closures.table);
+  mem_free(g, w.cache.v);
+  mem_free(g, w.cache_start.v);
+  mem_free(g, src);
+  mem_free(g, dst);
+
+  return g->status;
+}
+
+/* data structure for holding the state of the lookahead computation:
+ * the index among the @n nonterminal transitions of each transition
+ * (@ntx) and the states they leave (@state), a bitmap of the items
+ * followed by nullable symbols only (@tail), and the pairs of the
+ * relation being built (@src, @dst) and of the lookback relation
+ * (@lb_red, @lb_node).
+ */
+struct lr_la {
+  int n, *ntx, *state;
+  bits_t *tail;
+
+  struct vec src, dst, lb_red, lb_node;
+};
+
+/* lr_kernel_index(): get the index of the item @it in the kernel of
+ * state @s, or -1 if it is not there.
+ */
+static int lr_kernel_index (struct lr *a, int s, int it) {
+  int lo = a->kern_start[s], hi = a->kern_start[s + 1] - 1;
+
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+
+    if (a->kern[mid] == it)
+      return mid;
+    else if (a->kern[mid] < it)
+      lo = mid + 1;
+    else
+      hi = mid - 1;
+  }
+
+  return -1;
+}
+
+/* lr_step(): relate the item @it of state @s, whose follow set is that
+ * of @node, to what it reaches: the same item one symbol further in the
+ * next state, the transition on its symbol if only nullable symbols come
+ * after it, or the lookback of its reduction if it is complete.
+ */
+static void lr_step (grammar_t* g, struct lr *a, struct lr_la *l, int eps,
+                     int s, int it, int node) {
+  int sym = item_sym(g, it);
+
+  if (sym == 0) {
+    int prod = item_prod(g, it);
+
+    for (int r = a->red_start[s]; r < a->red_start[s + 1]; r++) {
+      if (a->red_prod[r] == prod) {
+        vec_push(g, &l->lb_red, r);
+        vec_push(g, &l->lb_node, node);
+      }
+    }
+
+    return;
+  }
+
+  int k = lr_find(a, s, sym);
+  int next = lr_kernel_index(a, a->trans_to[k], item_next(g, eps, it));
+
+  vec_push(g, &l->src, l->n + next);
+  vec_push(g, &l->dst, node);
+
+  if (l->ntx[k] >= 0 && bits_test(l->tail, it)) {
+    vec_push(g, &l->src, l->ntx[k]);
+    vec_push(g, &l->dst, node);
+  }
+}
+/* lr_lookaheads(): compute the lalr(1) lookaheads of every reduction of
+ * @a from the follow sets of the nonterminal transitions. those are
+ * first solved over the reads relation, and then over the includes
+ * relation, in which every production is followed through the automaton
+ * from each transition on its left-hand side. the walks are shared by
+ * giving each kernel item its own follow set, so every item of every
+ * state is only stepped over once. the slr(1) lookaheads of a reduction
+ * are the follow sets of all transitions on its left-hand side.
+ */
+static int lr_lookaheads (grammar_t* g, struct lr *a) {
+  struct relation reads = { NULL, NULL }, incl = { NULL, NULL };
+  struct relation alts = { NULL, NULL };
+  struct lr_la l;
+  int n_trans = a->trans_start[a->n_states], w = a->w, n = 0;
+  int n_kern = a->kern_start[a->n_states], n_red = a->red_start[a->n_states];
+  int eps = epsilon_index(g);
+  bits_t *F = NULL, *fol = NULL;
+
+  memset(&l, 0, sizeof(l));
+  l.src.cls = l.dst.cls = l.lb_red.cls = l.lb_node.cls = MEM_TEMP;
+  eps = (eps >= 0 ? g->terms[eps] : 0);
+
+  l.ntx = (int*) mem_alloc(g, MEM_TEMP, (n_trans + 1) * sizeof(int));
+  l.state = (int*) mem_alloc(g, MEM_TEMP, (n_trans + 1) * sizeof(int));
+  l.tail = sets_alloc(g, 1, bits_words(g->n_rhs));
+  int *from = (int*) mem_alloc(g, MEM_TEMP, (n_trans + 1) * sizeof(int));
+  int *src = (int*) mem_alloc(g, MEM_TEMP, (g->n_prods + 1) * sizeof(int));
+  int *dst = (int*) mem_alloc(g, MEM_TEMP, (g->n_prods + 1) * sizeof(int));
+
+  a->la = (bits_t*) mem_alloc(g, MEM_LR, (n_red * w + 1) * sizeof(bits_t));
+  a->slr = (bits_t*) mem_alloc(g, MEM_LR, (n_red * w + 1) * sizeof(bits_t));
+
+  /* number the nonterminal transitions, keeping their source states, and
+   * mark the items having only nullable symbols after their own.
+   */
+  for (int s = 0; s < a->n_states && !g->status; s++) {
+    for (int k = a->trans_start[s]; k < a->trans_start[s + 1]; k++) {
+      if (bits_test(g->sym_terminal, a->trans_sym[k] - 1))
+        l.ntx[k] = -1;
+      else {
+        from[n] = k;
+        l.state[n] = s;
+        l.ntx[k] = n++;
+      }
+    }
+  }
+
+  for (int p = 0; p < g->n_prods && !g->status; p++) {
+    const int *rhs = g->rhs + g->prod_off[p];
+
+    for (int i = g->prod_len[p] - 1; i >= 0; i--) {
+      bits_set(l.tail, g->prod_off[p] + i);
+
+      if (rhs[i] != eps && !bits_test(g->sym_empty, rhs[i] - 1))
+        break;
+    }
+  }
+
+  l.n = n;
+  F = sets_alloc(g, n + n_kern, w);
+  fol = sets_alloc(g, g->n_nonterms, w);
+
+  /* read directly: the terminals shifted after each transition, and the
+   * end of input after the start symbol. the reads relation steps over
+   * the nullable nonterminals that may come first.
+   */
+  for (int x = 0; x < n && !g->status; x++) {
+    int r = a->trans_to[from[x]];
+
+    if (r == a->accept)
+      bits_set(F + x * w, g->n_terms);
+
+    for (int k = a->trans_start[r]; k < a->trans_start[r + 1]; k++) {
+      int sym = a->trans_sym[k];
+
+      if (bits_test(g->sym_terminal, sym - 1))
+        bits_set(F + x * w, g->dense[sym - 1]);
+      else if (bits_test(g->sym_empty, sym - 1)) {
+        vec_push(g, &l.src, x);
+        vec_push(g, &l.dst, l.ntx[k]);
+      }
+    }
+  }
+
+  if (!g->status &&
+      !relation_build(g, &reads, n, l.src.n, l.src.v, l.dst.v))
+    digraph(g, n, &reads, F, w, NULL);
+
+  /* step over the first symbol of each production from every transition
+   * on its left-hand side, and then over each symbol of every kernel.
+   */
+  if (!g->status) {
+    for (int p = 0; p < g->n_prods; p++) {
+      src[p] = g->dense[g->prod_lhs[p] - 1];
+      dst[p] = p;
+    }
+
+    relation_build(g, &alts, g->n_nonterms, g->n_prods, src, dst);
+  }
+
+  l.src.n = l.dst.n = 0;
+
+  for (int x = 0; x < n && !g->status; x++) {
+    int d = g->dense[a->trans_sym[from[x]] - 1];
+
+    if (work_step(g, a->trans_sym[from[x]]))
+      break;
+
+    for (int j = alts.start[d]; j < alts.start[d + 1]; j++) {
+      int it = item_norm(g, eps, g->prod_off[alts.adj[j]]);
+      lr_step(g, a, &l, eps, l.state[x], it, x);
+    }
+  }
+
+  for (int s = 0; s < a->n_states && !g->status; s++) {
+    for (int k = a->kern_start[s]; k < a->kern_start[s + 1]; k++) {
+      if (a->kern[k] < item_aug(g))
+        lr_step(g, a, &l, eps, s, a->kern[k], n + k);
+    }
+  }
+
+  if (!g->status &&
+      !relation_build(g, &incl, n + n_kern, l.src.n, l.src.v, l.dst.v))
+    digraph(g, n + n_kern, &incl, F, w, NULL);
+
+  if (!g->status) {
+    bits_zero(a->la, n_red * w);
+
+    for (int i = 0; i < l.lb_red.n; i++)
+      bits_union(a->la + l.lb_red.v[i] * w, F + l.lb_node.v[i] * w, w);
+
+    for (int x = 0; x < n; x++) {
+      int d = g->dense[a->trans_sym[from[x]] - 1];
+      bits_union(fol + d * w, F + x * w, w);
+    }
+
+    for (int r = 0; r < n_red; r++) {
+      int d = g->dense[g->prod_lhs[a->red_prod[r]] - 1];
+      bits_copy(a->slr + r * w, fol + d * w, w);
+    }
+  }
+
+  relation_free(g, &reads);
+  relation_free(g, &incl);
+  relation_free(g, &alts);
+  mem_free(g, l.src.v);
+  mem_free(g, l.dst.v);
+  mem_free(g, l.lb_red.v);
+  mem_free(g, l.lb_node.v);
+  mem_free(g, l.ntx);
+  mem_free(g, l.state);
+  mem_free(g, l.tail);
+  mem_free(g, F);
+  mem_free(g, fol);
+  mem_free(g, from);
+  mem_free(g, src);
+  mem_free(g, dst);
+
+  return g->status;
+}
+
+/* lr_build(): build the lr(0) automaton of the grammar and the lalr(1)
+ * and slr(1) lookaheads of its reductions into @a. the nullable flags of
+ * the symbols must be known. if the automaton has more than @max_states
+ * states, @a is left truncated.
+ */
+int lr_build (grammar_t* g, struct lr *a, int max_states) {
+  memset(a, 0, sizeof(struct lr));
+  a->w = bits_words(g->n_terms + 1);
+  a->accept = -1;
+
+  grammar_phase(g, PHASE_LR);
+  if (g->status || g->n_prods == 0)
+    return g->status;
+
+  if (!lr_automaton(g, a, max_states) && !a->truncated)
+    lr_lookaheads(g, a);
+
+  return g->status;
+}
+
+/* lr_free(): deallocate the automaton @a.
+ */
+void lr_free (grammar_t* g, struct lr *a) {
+  mem_free(g, a->kern);
+  mem_free(g, a->kern_start);
+  mem_free(g, a->trans_start);
+  mem_free(g, a->trans_sym);
+  mem_free(g, a->trans_to);
+  mem_free(g, a->red_start);
+  mem_free(g, a->red_prod);
+  mem_free(g, a->la);
+  mem_free(g, a->slr);
+
+  memset(a, 0, sizeof(struct lr));
+}
+
+/* lr_print_item(): print the item @it, marking its position with a dot.
+ */
+static void lr_print_item (grammar_t* g, int it) {
+  const char *start = g->symbols[g->prod_lhs[0] - 1].name;
+
+  if (it >= item_aug(g)) {
+    printf("    $accept :%s %s%s $end\n", it == item_aug(g) ? " ." : "",
+           start, it == item_aug(g) ? "" : " .");
+    return;
+  }
+
+  int p = item_prod(g, it);
+  const int *rhs = g->rhs + g->prod_off[p];
+
+  printf("    %s :", g->symbols[g->prod_lhs[p] - 1].name);
+  for (int i = 0; i < g->prod_len[p]; i++)
+    printf("%s %s", g->prod_off[p] + i == it ? " ." : "",
+           g->symbols[rhs[i] - 1].name);
+
+  printf("%s\n", g->prod_off[p] + g->prod_len[p] == it ? " ." : "");
+}
+
+/* lr_print_conflict(): print the kernel of state @s and its @n_red
+ * reductions @reds competing with a shift (if @shift) on the terminal
+ * of dense index @t.
+ */
+static void lr_print_conflict (grammar_t* g, struct lr *a, int s, int t,
+                               bool shift, const int *reds, int n_red) {
+  bool end = (t == g->n_terms);
+
+  printf("  state %d, on %s:\n", s,
+         end ? "$end" : g->symbols[g->terms[t] - 1].name);
+
+  for (int k = a->kern_start[s]; k < a->kern_start[s + 1]; k++)
+    lr_print_item(g, a->kern[k]);
+
+  if (shift && end)
+    printf("      accept\n");
+  else if (shift)
+    printf("      shift, and go to state %d\n",
+           a->trans_to[lr_find(a, s, g->terms[t])]);
+
+  for (int i = 0; i < n_red; i++) {
+    int p = reds[i];
+    const int *rhs = g->rhs + g->prod_off[p];
+
+    printf("      reduce by %s :", g->symbols[g->prod_lhs[p] - 1].name);
+    for (int j = 0; j < g->prod_len[p]; j++)
+      printf(" %s", g->symbols[rhs[j] - 1].name);
+
+    printf("\n");
+  }
+
+  printf("\n");
+}
+
+/* lr_conflicts(): count the shift/reduce (@n_sr) and reduce/reduce
+ * (@n_rr) conflicts of the automaton @a under its lalr(1) lookaheads,
+ * or its slr(1) lookaheads if @slr is set, printing them if @print is
+ * set. as in bison, every terminal having both a shift and reductions
+ * in a state is one shift/reduce conflict, and each reduction after
+ * the first is one reduce/reduce conflict. returns the total.
+ */
+int lr_conflicts (grammar_t* g, struct lr *a, bool slr, bool print,
+                  int *n_sr, int *n_rr) {
+  const bits_t *la = (slr ? a->slr : a->la);
+  int w = a->w, max_red = 1;
+
+  *n_sr = *n_rr = 0;
+
+  for (int s = 0; s < a->n_states; s++) {
+    if (a->red_start[s + 1] - a->red_start[s] > max_red)
+      max_red = a->red_start[s + 1] - a->red_start[s];
+  }
+
+  bits_t *any = (bits_t*) mem_alloc(g, MEM_TEMP, (w + 1) * sizeof(bits_t));
+  int *reds = (int*) mem_alloc(g, MEM_TEMP, (max_red + 1) * sizeof(int));
+
+  for (int s = 0; s < a->n_states && !g->status; s++) {
+    int r0 = a->red_start[s], r1 = a->red_start[s + 1];
+
+    bits_zero(any, w);
+    for (int r = r0; r < r1; r++)
+      bits_union(any, la + r * w, w);
+
+    for (int t = bits_next(any, w, 0); t >= 0; t = bits_next(any, w, t + 1)) {
+      bool shift = (t == g->n_terms ? s == a->accept :
+                    lr_find(a, s, g->terms[t]) >= 0);
+      int n = 0;
+
+      for (int r = r0; r < r1; r++) {
+        if (bits_test(la + r * w, t))
+          reds[n++] = a->red_prod[r];
+      }
+
+      if (shift + n < 2)
+        continue;
+
+      if (shift)
+        (*n_sr)++;
+
+      if (n > 1)
+        *n_rr += n - 1;
+
+      if (print)
+        lr_print_conflict(g, a, s, t, shift, reds, n);
+    }
+  }
+
+  mem_free(g, any);
+  mem_free(g, reds);
+
+  return *n_sr + *n_rr;
+}
+
+/* lr_report(): print the lalr(1) conflicts of the grammar, if any, and
+ * whether it is slr(1) or lalr(1). a grammar whose lr(0) automaton has
+ * more than @max_states states is only noted as such.
+ */
+int lr_report (grammar_t* g, int max_states) {
+  int lalr_sr, lalr_rr, slr_sr, slr_rr;
+  struct lr a;
+
+  if (lr_build(g, &a, max_states) || a.truncated) {
+    if (a.truncated)
+      printf("LR(0) automaton: too large for the limit of %d states, "
+             "LR analysis skipped.\n\n", max_states);
+
+    lr_free(g, &a);
+    return g->status;
+  }
+
+  printf("LR(0) automaton: %d states.\n\n", a.n_states);
+
+  if (lr_conflicts(g, &a, false, false, &lalr_sr, &lalr_rr)) {
+    printf("LALR(1) conflicts:\n\n");
+    lr_conflicts(g, &a, false, true, &lalr_sr, &lalr_rr);
+  }
+
+  lr_conflicts(g, &a, true, false, &slr_sr, &slr_rr);
+
+  printf("  lalr(1): %d shift/reduce, %d reduce/reduce\n"
+         "  slr(1):  %d shift/reduce, %d reduce/reduce\n\n",
+         lalr_sr, lalr_rr, slr_sr, slr_rr);
+
+  if (slr_sr + slr_rr == 0)
+    printf("Grammar is SLR(1)\n\n");
+  else if (lalr_sr + lalr_rr == 0)
+    printf("Grammar is LALR(1), but not SLR(1)\n\n");
+  else
+    printf("Grammar is not LALR(1)\n\n");
+
+  lr_free(g, &a);
+  return g->status;
+}
@@ -0,0 +1,52 @@
+#ifndef LR_H
+#define LR_H
+
+#include "grammar.h"
+
+/* default number of lr(0) states past which the lr report is skipped,
+ * and the average number of kernel items and of transitions that those
+ * states may have each.
+ */
+#define LR_MAX_STATES 20000
+#define LR_SIZE_PER_STATE 64
+
+/* data structure for holding the lr(0) automaton of a grammar, augmented
+ * with the start production "$accept : S $end", along with the lalr(1)
+ * and slr(1) lookahead sets of its reductions.
+ */
+struct lr {
+  /* @n_states states, each having the kernel items @kern (starting at
+   * @kern_start), the transitions on symbols @trans_sym to the states
+   * @trans_to (starting at @trans_start, in symbol order) and the
+   * reductions by the productions @red_prod (starting at @red_start).
+   */
+  int n_states;
+  int *kern_start, *kern;
+  int *trans_start, *trans_sym, *trans_to;
+  int *red_start, *red_prod;
+
+  /* @accept: the state reached from the first on the start symbol. */
+  int accept;
+
+  /* @truncated: whether construction stopped at the state limit, or at
+   * its limits on kernel items and transitions, leaving the automaton
+   * incomplete and without lookaheads.
+   */
+  bool truncated;
+
+  /* lookahead sets of @w words, holding the terminals by dense index and
+   * the end of input after them: @la and @slr hold the lalr(1) and the
+   * slr(1) lookaheads of every reduction.
+   */
+  int w;
+  bits_t *la, *slr;
+};
+
+/* pre-declare lr analysis functions. */
+int lr_build (grammar_t* g, struct lr *a, int max_states);
+void lr_free (grammar_t* g, struct lr *a);
+int lr_conflicts (grammar_t* g, struct lr *a, bool slr, bool print,
+                  int *n_sr, int *n_rr);
+int lr_report (grammar_t* g, int max_states);
+
+#endif
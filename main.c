@@ -1,168 +1,284 @@
-#include <errno.h>
 #include <string.h>
 #include <stdarg.h>
 #include <stdlib.h>
 
+#include "compiled.h"
+#include "diff.h"
 #include "grammar.h"
-#include "ll1.h"
+#include "lr.h"
 #include "main.h"
+#include "query.h"
+#include "server.h"
 
 const char *argv0 = NULL;
 
-/* yyerror(): error reporting function called by bison on parse errors.
+/* kinds of queries answered without a full analysis. */
+enum {
+  QUERY_FIRST,
+  QUERY_FOLLOW,
+  QUERY_CHECK
+};
+
+/* data structure for holding one query from the command line: its
+ * @kind and the @name of the symbol it is about, which is NULL for a
+ * check of the whole grammar.
+ */
+struct request {
+  int kind;
+  const char *name;
+};
+
+/* derp(): write an error message to stderr and end execution.
+ */
+void derp (const char *fmt, ...) {
+  va_list vl;
+
+  fprintf(stderr, "%s: error: ", argv0);
+
+  va_start(vl, fmt);
+  vfprintf(stderr, fmt, vl);
+  va_end(vl);
+
+  fprintf(stderr, "\n");
+  fflush(stderr);
+  exit(1);
+}
+
+/* parse_size(): parse a byte count with an optional k, M or G suffix.
  */
-void yyerror (YYLTYPE* yylloc, file_t file, const char *msg) {
-  fprintf(stderr, "%s: error: %s:%d: %s\n", argv0, file.name, yylloc->first_line, msg);
+size_t parse_size (const char *str) {
+  char *end;
+  unsigned long long n = strtoull(str, &end, 10);
+
+  switch (*end) {
+    case 'k': case 'K': n <<= 10; end++; break;
+    case 'm': case 'M': n <<= 20; end++; break;
+    case 'g': case 'G': n <<= 30; end++; break;
+  }
+
+  if (end == str || *end || n == 0)
+    derp("%s: invalid memory size", str);
+
+  return (size_t) n;
 }
 
-/* yylex(): lexical analysis function that breaks the input grammar file
- * into a stream of tokens for the bison parser.
+/* parse_count(): parse a positive integer option value.
  */
-int yylex (YYSTYPE* yylval, YYLTYPE* yylloc, file_t file) {
-  int c, cprev, ntext;
-  char *text;
+int parse_count (const char *str) {
+  char *end;
+  long n = strtol(str, &end, 10);
+
+  if (end == str || *end || n <= 0 || n > 1000000000)
+    derp("%s: invalid count", str);
 
-  while (1) {
-    c = fgetc(file.descriptor);
-    text = NULL;
-    ntext = 0;
+  return (int) n;
+}
 
-    switch (c) {
-      case EOF: return c;
+/* parse_seconds(): parse a positive time limit in seconds.
+ */
+double parse_seconds (const char *str) {
+  char *end;
+  double t = strtod(str, &end);
 
-      case ':': return DERIVES;
-      case ';': return END;
-      case '|': return OR;
+  if (end == str || *end || !(t > 0))
+    derp("%s: invalid time limit", str);
 
-      case '\n':
-        yylloc->first_line++;
+  return t;
+}
+
+/* parse_steps(): parse the value of a --max-steps option, of the form
+ * "PHASE:N" or just "N" for every phase, into a step budget of @g.
+ */
+void parse_steps (grammar_t* g, const char *str) {
+  const char *colon = strchr(str, ':');
+  int phase = PHASE_NONE;
+
+  if (colon) {
+    size_t len = colon - str;
+
+    for (phase = PHASE_N_PHASES - 1; phase > PHASE_NONE; phase--) {
+      const char *name = phase_name(phase);
+
+      if (strlen(name) == len && strncmp(str, name, len) == 0)
         break;
     }
 
-    if (c == '/') {
-      c = fgetc(file.descriptor);
+    if (phase == PHASE_NONE)
+      derp("%s: unknown phase", str);
+  }
 
-      if (c == '/') {
-        while (c && c != '\n')
-          c = fgetc(file.descriptor);
+  work_set_budget(g, phase, parse_count(colon ? colon + 1 : str));
+}
 
-        if (c == EOF) return c;
-        yylloc->first_line++;
-      }
-      else if (c == '*') {
-        cprev = c;
-        c = fgetc(file.descriptor);
+/* option(): match the argument at index @i against the option @name
+ * taking a value, given as either "--name value" or "--name=value". on
+ * a match, @i is advanced past the value and the value is returned.
+ */
+const char *option (int argc, char **argv, int *i, const char *name) {
+  size_t len = strlen(name);
 
-        while (c && (cprev != '*' || c != '/')) {
-          cprev = c;
-          c = fgetc(file.descriptor);
+  if (strncmp(argv[*i], name, len) != 0)
+    return NULL;
 
-          if (c == '\n') yylloc->first_line++;
-        }
+  if (argv[*i][len] == '=')
+    return argv[*i] + len + 1;
 
-        if (c == EOF) return c;
-      }
-      else
-        fseek(file.descriptor, -1, SEEK_CUR);
-    }
+  if (argv[*i][len] != '\0')
+    return NULL;
 
-    if (c == '\'') {
-      text = (char*) malloc((++ntext + 1) * sizeof(char));
-      if (!text)
-        derp("unable to allocate token buffer");
+  if (*i + 1 >= argc)
+    derp("%s: value required", name);
 
-      text[0] = fgetc(file.descriptor);
-      text[1] = '\0';
+  return argv[++(*i)];
+}
 
-      c = fgetc(file.descriptor);
-      yylval->id = text;
-      if (c == '\'' || text[0] != '\'')
-        return ID;
+/* parse_query(): parse the value of a --query option, of the form
+ * "first:SYMBOL" or "follow:SYMBOL", into @req.
+ */
+void parse_query (const char *str, struct request *req) {
+  if (strncmp(str, "first:", 6) == 0)
+    req->kind = QUERY_FIRST, req->name = str + 6;
+  else if (strncmp(str, "follow:", 7) == 0)
+    req->kind = QUERY_FOLLOW, req->name = str + 7;
+  else
+    derp("%s: invalid query", str);
+
+  if (*req->name == '\0')
+    derp("%s: symbol required", str);
+}
 
-      free(text);
-    }
+/* check_all(): print the conflicts of every nonterminal of the grammar
+ * @g, computing the predict sets of each just before checking it. if
+ * @fail_fast is set, nothing past the first conflicting nonterminal is
+ * analyzed. otherwise, if @lr_states is nonzero, a grammar having
+ * conflicts is also checked for lalr(1) conflicts with up to that many
+ * lr(0) states. returns nonzero if any conflict was found.
+ */
+int check_all (struct query *q, grammar_t* g, bool fail_fast,
+               int lr_states) {
+  int n = 0;
 
-    if (c == '\"') {
-      text = (char*) malloc((++ntext + 1) * sizeof(char));
-      if (!text)
-        derp("unable to allocate token buffer");
+  for (int sym = 1; sym <= g->n_symbols && !g->status; sym++) {
+    if (grammar_is_terminal(g, sym))
+      continue;
 
-      text[0] = fgetc(file.descriptor);
-      text[1] = '\0';
+    n = query_check(q, sym, n, true);
 
-      c = fgetc(file.descriptor);
-      while ((c != '\"')) {
-        text = (char*) realloc(text, (++ntext + 1) * sizeof(char));
-        if (!text)
-          derp("unable to reallocate token buffer");
+    if (n && fail_fast)
+      break;
+  }
 
-        text[ntext - 1] = c;
-        text[ntext] = '\0';
+  if (g->status)
+    return 0;
 
-        c = fgetc(file.descriptor);
-      }
+  if (n)
+    printf("There were conflicts.\nGrammar is not LL(1)\n  :(\n\n");
+  else
+    printf("No conflicts, grammar is LL(1)\n  :D :D :D\n\n");
 
-      yylval->id = text;
+  if (n && !fail_fast && lr_states)
+    lr_report(g, lr_states);
 
-      if (c == '\"')
-        return ALIAS;
+  return (n > 0);
+}
 
-      free(text);
-    }
+/* run_queries(): answer the @n queries in @reqs against the grammar @g,
+ * computing only what they depend on unless the grammar has been
+ * @analyzed already. if @fail_fast is set, no query is answered after
+ * the first check that finds conflicts. @lr_states is passed on to
+ * check_all(). returns nonzero if any check found conflicts.
+ */
+int run_queries (grammar_t* g, struct request *reqs, int n, bool analyzed,
+                 bool fail_fast, int lr_states) {
+  struct query q;
+  int has_conflicts = 0;
 
-    if (c == '%' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
-      text = (char*) malloc((++ntext + 1) * sizeof(char));
-      if (!text)
-        derp("unable to allocate token buffer");
+  if (query_init(&q, g, analyzed))
+    derp("%s", grammar_error(g));
 
-      text[0] = c;
-      text[1] = '\0';
+  for (int i = 0; i < n && !(has_conflicts && fail_fast); i++) {
+    const char *name = reqs[i].name;
+    int sym = (name ? symbols_find(g, (char*) name) : 0);
 
-      c = fgetc(file.descriptor);
-      while ((c >= 'a' && c <= 'z') ||
-             (c >= 'A' && c <= 'Z') ||
-             (c >= '0' && c <= '9') ||
-              c == '_') {
-        text = (char*) realloc(text, (++ntext + 1) * sizeof(char));
-        if (!text)
-          derp("unable to reallocate token buffer");
+    if (name && !sym)
+      derp("%s: unknown symbol", name);
 
-        text[ntext - 1] = c;
-        text[ntext] = '\0';
+    if (reqs[i].kind == QUERY_CHECK && !name)
+      has_conflicts |= check_all(&q, g, fail_fast, lr_states);
+    else if (reqs[i].kind == QUERY_FIRST) {
+      const int *set = query_first(&q, sym);
 
-        c = fgetc(file.descriptor);
+      if (!g->status) {
+        printf("  first(%s):", name);
+        symv_print(g, (int*) set);
       }
+    }
+    else if (reqs[i].kind == QUERY_FOLLOW) {
+      const int *set = query_follow(&q, sym);
 
-      fseek(file.descriptor, -1, SEEK_CUR);
+      if (!g->status) {
+        printf("  follow(%s):", name);
+        symv_print(g, (int*) set);
+      }
+    }
+    else {
+      if (grammar_is_terminal(g, sym))
+        derp("%s: not a nonterminal", name);
 
-      yylval->id = text;
-      if (text[0] == '%') {
-        if (strcmp(text, STR_EPSILON) == 0)
-          return EPSILON;
-        else if (strcmp(text, STR_TOKEN) == 0)
-          return TOKEN;
-        else
-          free(text);
+      int k = query_check(&q, sym, 0, true);
+
+      if (!g->status && k) {
+        printf("There were conflicts in %s.\n\n", name);
+        has_conflicts = 1;
       }
-      else
-        return ID;
+      else if (!g->status)
+        printf("No conflicts in %s.\n\n", name);
     }
+
+    if (g->status)
+      derp("%s", grammar_error(g));
   }
+
+  query_free(&q);
+  return has_conflicts;
 }
 
-/* derp(): write an error message to stderr and end execution.
+/* usage(): print the command line synopsis and end execution.
  */
-void derp (const char *fmt, ...) {
-  va_list vl;
-
-  fprintf(stderr, "%s: error: ", argv0);
-
-  va_start(vl, fmt);
-  vfprintf(stderr, fmt, vl);
-  va_end(vl);
+void usage (void) {
+  fprintf(stderr,
+    "usage: %s [options] grammar.y ...\n"
+    "       %s [options] --load grammar.ll1c\n"
+    "       %s --server [--socket PATH] [grammar.y]\n"
+    "       %s --differential [--generate N] [grammar.y ...]\n"
+    "\n"
+    "options:\n"
+    "  --threads N            parse the grammar on N threads\n"
+    "  --cache-dir DIR        keep parsed modules in DIR for later runs\n"
+    "  --engine NAME          analyze with the 'optimized' (default) or\n"
+    "                         'reference' engine\n"
+    "  --prune                remove unreachable and non-productive symbols\n"
+    "  --prune-report         prune, and print what was removed\n"
+    "  --emit-compiled FILE   write a compiled image of the analyzed grammar\n"
+    "  --load FILE            read a compiled image instead of a grammar\n"
+    "  --max-memory SIZE      fail once SIZE bytes (k, M or G) are in use\n"
+    "  --memory-report        print the memory used by each class and phase\n"
+    "  --timeout SECONDS      fail once the analysis has run for SECONDS\n"
+    "  --max-steps [PHASE:]N  fail after N steps of PHASE, or of any phase\n"
+    "  --query KIND:SYMBOL    print only the first or follow set of SYMBOL\n"
+    "  --check                print only the conflicts of the grammar\n"
+    "  --check=SYMBOL         print only the conflicts of SYMBOL\n"
+    "  --fail-fast            stop checking at the first conflict\n"
+    "  --lr                   report LALR(1) conflicts if not LL(1)\n"
+    "  --lr-states N          give up on the LR check past N states\n"
+    "  --server               answer json queries read from stdin\n"
+    "  --socket PATH          answer json queries on a unix socket\n"
+    "  --differential         compare both engines on every grammar\n"
+    "  --generate N           also compare them on N random grammars\n"
+    "  --size N               use up to N nonterminals per random grammar\n"
+    "  --seed N               seed the random grammar generator\n",
+    argv0, argv0, argv0, argv0);
 
-  fprintf(stderr, "\n");
-  fflush(stderr);
   exit(1);
 }
 
@@ -171,32 +287,169 @@ void derp (const char *fmt, ...) {
 int main (int argc, char **argv) {
 	grammar_t g;
 
-  symbols_init(&g);
-  prods_init(&g);
-  aliases_init(&g);
+  const char *val;
+  const char *emit_fname = NULL;
+  const char *load_fname = NULL;
+  const char *socket_path = NULL;
+  int server = 0, mem_report = 0, differential = 0;
+  int do_prune = 0, prune_report = 0, fail_fast = 0;
+  int lr = 0, lr_states = LR_MAX_STATES;
+  int n_generate = 0, size = 50;
+  unsigned int seed = 1;
+
+  char **files = (char**) calloc(argc, sizeof(char*));
+  int n_files = 0;
+
+  struct request *reqs = (struct request*)
+    calloc(argc, sizeof(struct request));
+  int n_reqs = 0;
+
+  grammar_init(&g);
 
   argv0 = argv[0];
 
-  if (argc != 2)
-    derp("input filename required");
+  if (!files || !reqs)
+    derp("unable to allocate argument list");
+
+  for (int i = 1; i < argc; i++) {
+    if ((val = option(argc, argv, &i, "--emit-compiled")))
+      emit_fname = val;
+    else if ((val = option(argc, argv, &i, "--load")))
+      load_fname = val;
+    else if ((val = option(argc, argv, &i, "--max-memory")))
+      mem_set_limit(&g, parse_size(val));
+    else if (strcmp(argv[i], "--memory-report") == 0)
+      mem_report = 1;
+    else if ((val = option(argc, argv, &i, "--timeout")))
+      work_set_timeout(&g, parse_seconds(val));
+    else if ((val = option(argc, argv, &i, "--max-steps")))
+      parse_steps(&g, val);
+    else if ((val = option(argc, argv, &i, "--query")))
+      parse_query(val, reqs + n_reqs++);
+    else if (strcmp(argv[i], "--check") == 0)
+      reqs[n_reqs++].kind = QUERY_CHECK;
+    else if (strncmp(argv[i], "--check=", 8) == 0) {
+      reqs[n_reqs].kind = QUERY_CHECK;
+      reqs[n_reqs++].name = argv[i] + 8;
+    }
+    else if (strcmp(argv[i], "--fail-fast") == 0)
+      fail_fast = 1;
+    else if (strcmp(argv[i], "--lr") == 0)
+      lr = 1;
+    else if ((val = option(argc, argv, &i, "--lr-states")))
+      lr = 1, lr_states = parse_count(val);
+    else if (strcmp(argv[i], "--prune") == 0)
+      do_prune = 1;
+    else if (strcmp(argv[i], "--no-prune") == 0)
+      do_prune = prune_report = 0;
+    else if (strcmp(argv[i], "--prune-report") == 0)
+      do_prune = prune_report = 1;
+    else if ((val = option(argc, argv, &i, "--threads")))
+      g.threads = parse_count(val);
+    else if ((val = option(argc, argv, &i, "--cache-dir")))
+      g.cache_dir = val;
+    else if ((val = option(argc, argv, &i, "--engine"))) {
+      if (strcmp(val, "optimized") == 0)
+        g.engine = ENGINE_OPTIMIZED;
+      else if (strcmp(val, "reference") == 0)
+        g.engine = ENGINE_REFERENCE;
+      else
+        derp("%s: unknown engine", val);
+    }
+    else if (strcmp(argv[i], "--server") == 0)
+      server = 1;
+    else if ((val = option(argc, argv, &i, "--socket")))
+      socket_path = val, server = 1;
+    else if (strcmp(argv[i], "--differential") == 0)
+      differential = 1;
+    else if ((val = option(argc, argv, &i, "--generate")))
+      n_generate = parse_count(val);
+    else if ((val = option(argc, argv, &i, "--size")))
+      size = parse_count(val);
+    else if ((val = option(argc, argv, &i, "--seed")))
+      seed = parse_count(val);
+    else if (strncmp(argv[i], "--", 2) == 0)
+      usage();
+    else
+      files[n_files++] = argv[i];
+  }
+
+  /* failing fast only makes sense when checking. */
+  if (fail_fast && n_reqs == 0)
+    reqs[n_reqs++].kind = QUERY_CHECK;
+
+  if (differential) {
+    free(reqs);
+    grammar_free(&g);
+    return diff_run(n_files, files, n_generate, size, seed);
+  }
+
+  const char *fname = files[0];
+
+  if (server) {
+    if (load_fname || emit_fname || n_reqs || n_files > 1)
+      usage();
+
+    free(files);
+    free(reqs);
+    grammar_free(&g);
+    return (socket_path ? server_run_socket(fname, socket_path)
+                        : server_run_stdio(fname));
+  }
 
-  file_t file = {
-    .name = argv[1],
-    .descriptor = fopen(argv[1], "r")
-  };
+  if (n_reqs && emit_fname)
+    usage();
 
-  if (!file.descriptor)
-    derp("%s: %s", file.name, strerror(errno));
+  if (load_fname) {
+    if (fname)
+      usage();
+
+    if (compiled_load(&g, load_fname))
+      derp("%s", grammar_error(&g));
+  }
+  else {
+    if (!fname)
+      derp("input filename required");
+
+    if (grammar_parse_files(&g, n_files, files) ||
+        (do_prune && prune(&g, prune_report)))
+      derp("%s", grammar_error(&g));
+
+    /* queries compute only what they need, except under the reference
+     * engine, which always analyzes the whole grammar. a report cut
+     * short by a limit still prints the phases that were completed.
+     */
+    if ((!n_reqs || g.engine == ENGINE_REFERENCE) &&
+        (derives_empty(&g) || first(&g) || follow(&g) || predict(&g)) &&
+        (n_reqs || g.status != LL1_ELIMIT))
+      derp("%s", grammar_error(&g));
+  }
 
-  if (yyparse(file, &g))
-    derp("%s: parse failed", file.name);
+  free(files);
+
+  if (n_reqs) {
+    bool analyzed = (load_fname || g.engine == ENGINE_REFERENCE);
+    int has_conflicts = run_queries(&g, reqs, n_reqs, analyzed, fail_fast,
+                                    lr ? lr_states : 0);
+
+    if (mem_report) {
+      printf("Memory usage:\n\n");
+      mem_print(&g);
+    }
+
+    free(reqs);
+    grammar_free(&g);
+
+    return (has_conflicts) ? 1 : 0;
+  }
 
-  fclose(file.descriptor);
+  free(reqs);
 
-  derives_empty(&g);
-  first(&g);
-  follow(&g);
-  predict(&g);
+  /* phases before the one that failed, if any, are complete. */
+  int done = (g.status ? g.phase : PHASE_N_PHASES);
+
+  if (emit_fname && !g.status && compiled_write(&g, emit_fname))
+    derp("%s", grammar_error(&g));
 
   printf("Terminal symbols:\n\n");
   symbols_print(&g, 1);
@@ -210,24 +463,45 @@ int main (int argc, char **argv) {
   prods_print(&g);
   printf("\n");
 
-  printf("Empty derivations:\n\n");
-  symbols_print_empty(&g);
-  printf("\n");
+  if (done > PHASE_EMPTY) {
+    printf("Empty derivations:\n\n");
+    symbols_print_empty(&g);
+    printf("\n");
+  }
+
+  if (done > PHASE_FIRST) {
+    printf("First sets:\n\n");
+    symbols_print_first(&g);
+  }
+
+  if (done > PHASE_FOLLOW) {
+    printf("Follow sets:\n\n");
+    symbols_print_follow(&g);
+  }
+
+  bool has_conflicts = false;
+
+  if (done > PHASE_PREDICT) {
+    printf("Predict sets:\n\n");
+    prods_print_predict(&g);
 
-  printf("First sets:\n\n");
-  symbols_print_first(&g);
+    has_conflicts = conflicts(&g);
 
-  printf("Follow sets:\n\n");
-  symbols_print_follow(&g);
+    if (has_conflicts && lr && !g.status)
+      lr_report(&g, lr_states);
+  }
 
-  printf("Predict sets:\n\n");
-  prods_print_predict(&g);
+  if (g.status) {
+    fflush(stdout);
+    derp("%s", grammar_error(&g));
+  }
 
-  bool has_conflicts = conflicts(&g);
+  if (mem_report) {
+    printf("Memory usage:\n\n");
+    mem_print(&g);
+  }
 
-  aliases_free(&g);
-  symbols_free(&g);
-  prods_free(&g);
+  grammar_free(&g);
 
   return (has_conflicts) ? 1 : 0;
 }
@@ -0,0 +1,287 @@
+#include "grammar.h"
+#include "engine.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* reasons for removing a symbol from the grammar. */
+enum {
+  PRUNE_KEEP,
+  PRUNE_NONPRODUCTIVE,
+  PRUNE_UNREACHABLE
+};
+
+/* prune_productive(): mark every nonterminal that derives a string of
+ * terminals in @productive, counting in @pending the occurrences of
+ * symbols not yet known to be productive in each right-hand side. each
+ * occurrence is visited at most once.
+ */
+static int prune_productive (grammar_t* g, char *productive, int *pending) {
+  struct relation occ = { NULL, NULL };
+  int m = g->n_rhs - g->n_prods, n_work = 0;
+
+  int *src = (int*) mem_alloc(g, MEM_TEMP, (m + 1) * sizeof(int));
+  int *dst = (int*) mem_alloc(g, MEM_TEMP, (m + 1) * sizeof(int));
+  int *work = (int*) mem_alloc(g, MEM_TEMP, (g->n_symbols + 1) * sizeof(int));
+
+  if (!g->status) {
+    for (int i = 0; i < g->n_symbols; i++)
+      productive[i] = (char) bits_test(g->sym_terminal, i);
+
+    m = 0;
+    for (int i = 0; i < g->n_prods; i++) {
+      int *rhs = g->rhs + g->prod_off[i];
+      pending[i] = 0;
+
+      for (int j = 0; j < g->prod_len[i]; j++) {
+        if (bits_test(g->sym_terminal, rhs[j] - 1))
+          continue;
+
+        pending[i]++;
+        src[m] = rhs[j] - 1;
+        dst[m++] = i;
+      }
+    }
+  }
+
+  if (!g->status && !relation_build(g, &occ, g->n_symbols, m, src, dst)) {
+    for (int i = 0; i < g->n_prods; i++) {
+      int lhs = g->prod_lhs[i] - 1;
+
+      if (pending[i] == 0 && !productive[lhs]) {
+        productive[lhs] = 1;
+        work[n_work++] = lhs;
+      }
+    }
+
+    while (n_work) {
+      int k = work[--n_work];
+
+      for (int j = occ.start[k]; j < occ.start[k + 1]; j++) {
+        int i = occ.adj[j], lhs = g->prod_lhs[i] - 1;
+
+        if (--pending[i] == 0 && !productive[lhs]) {
+          productive[lhs] = 1;
+          work[n_work++] = lhs;
+        }
+      }
+    }
+  }
+
+  relation_free(g, &occ);
+  mem_free(g, src);
+  mem_free(g, dst);
+  mem_free(g, work);
+
+  return g->status;
+}
+
+/* prune_reachable(): mark every symbol reachable from the left-hand side
+ * of the first production in @reached, following only productions that
+ * have no @pending unproductive symbols.
+ */
+static int prune_reachable (grammar_t* g, char *reached,
+                            const int *pending) {
+  struct relation alts = { NULL, NULL };
+  int n_work = 0;
+
+  int *src = (int*) mem_alloc(g, MEM_TEMP, (g->n_prods + 1) * sizeof(int));
+  int *dst = (int*) mem_alloc(g, MEM_TEMP, (g->n_prods + 1) * sizeof(int));
+  int *work = (int*) mem_alloc(g, MEM_TEMP, (g->n_symbols + 1) * sizeof(int));
+
+  if (!g->status) {
+    for (int i = 0; i < g->n_prods; i++) {
+      src[i] = g->prod_lhs[i] - 1;
+      dst[i] = i;
+    }
+  }
+
+  if (!g->status &&
+      !relation_build(g, &alts, g->n_symbols, g->n_prods, src, dst)) {
+    memset(reached, 0, g->n_symbols);
+
+    if (g->n_prods) {
+      reached[g->prod_lhs[0] - 1] = 1;
+      work[n_work++] = g->prod_lhs[0] - 1;
+    }
+
+    while (n_work) {
+      int k = work[--n_work];
+
+      for (int j = alts.start[k]; j < alts.start[k + 1]; j++) {
+        int i = alts.adj[j], *rhs = g->rhs + g->prod_off[i];
+
+        if (pending[i])
+          continue;
+
+        for (int r = 0; r < g->prod_len[i]; r++) {
+          if (!reached[rhs[r] - 1]) {
+            reached[rhs[r] - 1] = 1;
+            work[n_work++] = rhs[r] - 1;
+          }
+        }
+      }
+    }
+  }
+
+  relation_free(g, &alts);
+  mem_free(g, src);
+  mem_free(g, dst);
+  mem_free(g, work);
+
+  return g->status;
+}
+
+/* prune_print(): print the symbols and productions about to be removed,
+ * given the removal @reason of each symbol.
+ */
+static void prune_print (grammar_t* g, const char *reason,
+                         const int *pending, int n_syms, int n_prods) {
+  if (n_syms == 0 && n_prods == 0) {
+    printf("Pruned symbols:\n\n  none\n\n");
+    return;
+  }
+
+  printf("Pruned symbols:\n\n");
+  for (int i = 0; i < g->n_symbols; i++) {
+    if (reason[i] == PRUNE_NONPRODUCTIVE)
+      printf("  %s (non-productive)\n", g->symbols[i].name);
+    else if (reason[i] == PRUNE_UNREACHABLE)
+      printf("  %s (unreachable)\n", g->symbols[i].name);
+  }
+
+  printf("\nPruned productions:\n\n");
+  for (int i = 0; i < g->n_prods; i++) {
+    int lhs = g->prod_lhs[i], *rhs = g->rhs + g->prod_off[i];
+
+    if (reason[lhs - 1] == PRUNE_KEEP && pending[i] == 0)
+      continue;
+
+    printf("  %s :", g->symbols[lhs - 1].name);
+    for (int j = 0; j < g->prod_len[i]; j++)
+      printf(" %s", g->symbols[rhs[j] - 1].name);
+
+    printf("\n");
+  }
+
+  printf("\n");
+}
+
+/* prune_compact(): remove every symbol having a nonzero removal @reason
+ * and every production with a removed left-hand side or @pending
+ * unproductive symbols, renumbering the symbols that remain.
+ */
+static int prune_compact (grammar_t* g, const char *reason,
+                          const int *pending) {
+  int *map = (int*) mem_alloc(g, MEM_TEMP, (g->n_symbols + 1) * sizeof(int));
+  int n = 0, n_old;
+
+  if (!map)
+    return g->status;
+
+  for (int i = 0; i < g->n_symbols; i++) {
+    if (reason[i] != PRUNE_KEEP) {
+      mem_free(g, g->symbols[i].name);
+      map[i] = 0;
+      continue;
+    }
+
+    g->symbols[n] = g->symbols[i];
+    bits_put(g->sym_terminal, n, bits_test(g->sym_terminal, i));
+    bits_put(g->sym_empty, n, bits_test(g->sym_empty, i));
+    bits_put(g->sym_visited, n, bits_test(g->sym_visited, i));
+    map[i] = ++n;
+  }
+
+  /* clear the flags left behind the last symbol kept. */
+  for (n_old = g->n_symbols; n < n_old; n_old--) {
+    bits_clear(g->sym_terminal, n_old - 1);
+    bits_clear(g->sym_empty, n_old - 1);
+    bits_clear(g->sym_visited, n_old - 1);
+  }
+
+  g->n_symbols = n;
+
+  /* right-hand sides are moved down the shared store in order, so that
+   * no kept symbol is overwritten before it has been read.
+   */
+  int m = 0;
+
+  n = 0;
+  for (int i = 0; i < g->n_prods; i++) {
+    int lhs = g->prod_lhs[i], len = g->prod_len[i];
+    int *src = g->rhs + g->prod_off[i], *dst = g->rhs + m;
+
+    if (reason[lhs - 1] != PRUNE_KEEP || pending[i])
+      continue;
+
+    for (int j = 0; j <= len; j++)
+      dst[j] = (j < len ? map[src[j] - 1] : 0);
+
+    g->prods[n] = g->prods[i];
+    g->prod_lhs[n] = map[lhs - 1];
+    g->prod_off[n] = m;
+    g->prod_len[n] = len;
+    g->prod_yield[n] = g->prod_yield[i];
+    bits_put(g->prod_empty, n, bits_test(g->prod_empty, i));
+
+    m += len + 1;
+    n++;
+  }
+
+  g->n_rhs = m;
+
+  for (n_old = g->n_prods; n < n_old; n_old--)
+    bits_clear(g->prod_empty, n_old - 1);
+
+  g->n_prods = n;
+
+  mem_free(g, map);
+  return g->status;
+}
+
+/* prune(): remove the nonterminals that derive no string of terminals,
+ * then every symbol unreachable from the left-hand side of the first
+ * rule, along with their productions. the start symbol is always kept.
+ * the removed symbols and productions are printed if @print is set. as
+ * symbols are renumbered, this must run before the analysis.
+ */
+int prune (grammar_t* g, bool print) {
+  int n_syms = 0, n_prods = 0;
+
+  grammar_phase(g, PHASE_PRUNE);
+
+  char *productive = (char*) mem_alloc(g, MEM_TEMP, g->n_symbols + 1);
+  char *reached = (char*) mem_alloc(g, MEM_TEMP, g->n_symbols + 1);
+  int *pending = (int*) mem_alloc(g, MEM_TEMP, (g->n_prods + 1) * sizeof(int));
+
+  if (!g->status && !prune_productive(g, productive, pending) &&
+      !prune_reachable(g, reached, pending)) {
+    /* reuse @reached to hold the removal reason of each symbol. */
+    for (int i = 0; i < g->n_symbols; i++) {
+      if (!reached[i])
+        reached[i] = (productive[i] ? PRUNE_UNREACHABLE
+                                    : PRUNE_NONPRODUCTIVE);
+      else
+        reached[i] = PRUNE_KEEP;
+
+      n_syms += (reached[i] != PRUNE_KEEP);
+    }
+
+    for (int i = 0; i < g->n_prods; i++)
+      n_prods += (reached[g->prod_lhs[i] - 1] != PRUNE_KEEP ||
+                  pending[i] != 0);
+
+    if (print)
+      prune_print(g, reached, pending, n_syms, n_prods);
+
+    if (n_syms || n_prods)
+      prune_compact(g, reached, pending);
+  }
+
+  mem_free(g, productive);
+  mem_free(g, reached);
+  mem_free(g, pending);
+
+  return g->status;
+}
@@ -0,0 +1,626 @@
+#include "query.h"
+#include "bitset.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* lazy queries solve the same relations as the optimized engine, but only
+ * over the cone of nonterminals that the requested answer depends on.
+ * every nullable flag and set found is final, and is kept in the grammar
+ * just as the full analysis would have left it, so later queries take it
+ * as a constant instead of solving it again.
+ */
+
+/* cone_add(): append the nonterminal of dense index @x to the @cone of
+ * @n nodes, recording its position in @pos, unless it is there already.
+ */
+static void cone_add (int *pos, int *cone, int *n, int x) {
+  if (pos[x] < 0) {
+    pos[x] = *n;
+    cone[(*n)++] = x;
+  }
+}
+
+/* cone_reset(): forget the positions in @pos of the @n nodes of @cone.
+ */
+static void cone_reset (int *pos, const int *cone, int n) {
+  for (int i = 0; i < n; i++)
+    pos[cone[i]] = -1;
+}
+
+/* query_init(): prepare lazy queries against the grammar @g. if the
+ * grammar has been @analyzed already, all of its results are final.
+ */
+int query_init (struct query *q, grammar_t* g, bool analyzed) {
+  memset(q, 0, sizeof(struct query));
+  q->g = g;
+
+  if (!g->dense && symbols_number(g))
+    return g->status;
+
+  q->eps = epsilon_index(g);
+
+  int n = g->n_nonterms, np = g->n_prods;
+
+  q->empty_done = sets_alloc(g, 1, bits_words(n));
+  q->first_done = sets_alloc(g, 1, bits_words(n));
+  q->follow_done = sets_alloc(g, 1, bits_words(n));
+  q->predict_done = sets_alloc(g, 1, bits_words(np));
+  q->local = (int*) mem_alloc(g, MEM_TEMP, (n + 1) * sizeof(int));
+  q->up = (int*) mem_alloc(g, MEM_TEMP, (n + 1) * sizeof(int));
+
+  int *src = (int*) mem_alloc(g, MEM_TEMP, (np + 1) * sizeof(int));
+  int *dst = (int*) mem_alloc(g, MEM_TEMP, (np + 1) * sizeof(int));
+
+  if (!g->status) {
+    for (int i = 0; i < n; i++)
+      q->local[i] = q->up[i] = -1;
+
+    for (int i = 0; i < np; i++) {
+      src[i] = g->dense[g->prod_lhs[i] - 1];
+      dst[i] = i;
+    }
+
+    relation_build(g, &q->alts, n, np, src, dst);
+  }
+
+  mem_free(g, src);
+  mem_free(g, dst);
+
+  if (g->status)
+    return g->status;
+
+  if (analyzed) {
+    for (int i = 0; i < n; i++) {
+      bits_set(q->empty_done, i);
+      bits_set(q->first_done, i);
+      bits_set(q->follow_done, i);
+    }
+
+    for (int i = 0; i < np; i++)
+      bits_set(q->predict_done, i);
+  }
+  else {
+    bits_zero(g->sym_empty, bits_words(g->n_symbols));
+    bits_zero(g->prod_empty, bits_words(np));
+
+    if (q->eps >= 0)
+      bits_set(g->sym_empty, g->terms[q->eps] - 1);
+  }
+
+  return g->status;
+}
+
+/* query_free(): deallocate the state of lazy queries. the results found
+ * remain in the grammar.
+ */
+void query_free (struct query *q) {
+  grammar_t *g = q->g;
+
+  relation_free(g, &q->alts);
+  relation_free(g, &q->occ);
+  mem_free(g, q->empty_done);
+  mem_free(g, q->first_done);
+  mem_free(g, q->follow_done);
+  mem_free(g, q->predict_done);
+  mem_free(g, q->local);
+  mem_free(g, q->up);
+}
+
+/* query_occ(): index the productions by the nonterminals occurring in
+ * them, listing each production once per nonterminal. this is only
+ * needed by follow sets, so it is built on first use.
+ */
+static int query_occ (struct query *q) {
+  grammar_t *g = q->g;
+  int n = g->n_nonterms, m = g->n_rhs - g->n_prods, k = 0;
+
+  if (q->occ.start)
+    return g->status;
+
+  int *src = (int*) mem_alloc(g, MEM_TEMP, (m + 1) * sizeof(int));
+  int *dst = (int*) mem_alloc(g, MEM_TEMP, (m + 1) * sizeof(int));
+  int *last = (int*) mem_alloc(g, MEM_TEMP, (n + 1) * sizeof(int));
+
+  if (!g->status) {
+    for (int i = 0; i < n; i++)
+      last[i] = -1;
+
+    for (int p = 0; p < g->n_prods; p++) {
+      int *rhs = g->rhs + g->prod_off[p];
+
+      for (int j = 0; j < g->prod_len[p]; j++) {
+        int s = rhs[j] - 1, d = g->dense[s];
+
+        if (bits_test(g->sym_terminal, s) || last[d] == p)
+          continue;
+
+        last[d] = p;
+        src[k] = d;
+        dst[k++] = p;
+      }
+    }
+
+    relation_build(g, &q->occ, n, k, src, dst);
+  }
+
+  mem_free(g, src);
+  mem_free(g, dst);
+  mem_free(g, last);
+
+  return g->status;
+}
+
+/* query_empty_prod(): mark production @p as deriving epsilon once none
+ * of its symbols is left to settle, queueing its left-hand side on the
+ * @work list by cone position if it was not yet known to.
+ */
+static void query_empty_prod (struct query *q, int p,
+                              int *work, int *n_work) {
+  grammar_t *g = q->g;
+  int lhs = g->prod_lhs[p] - 1;
+
+  if (g->prod_yield[p])
+    return;
+
+  bits_set(g->prod_empty, p);
+
+  if (!bits_test(g->sym_empty, lhs)) {
+    bits_set(g->sym_empty, lhs);
+    work[(*n_work)++] = q->local[g->dense[lhs]];
+  }
+}
+
+/* query_empty(): settle whether the nonterminal of dense index @x, and
+ * every unsettled nonterminal reachable from it, derive epsilon. the
+ * productions of all of them are settled along the way.
+ */
+static int query_empty (struct query *q, int x) {
+  grammar_t *g = q->g;
+  struct relation occ = { NULL, NULL };
+  int nc = 0, m = 0, k = 0, n_work = 0, phase = g->phase;
+
+  if (g->status || bits_test(q->empty_done, x))
+    return g->status;
+
+  grammar_phase(g, PHASE_EMPTY);
+
+  int *cone = (int*)
+    mem_alloc(g, MEM_TEMP, (g->n_nonterms + 1) * sizeof(int));
+  if (!cone)
+    return g->status;
+
+  cone_add(q->local, cone, &nc, x);
+
+  for (int c = 0; c < nc; c++) {
+    for (int a = q->alts.start[cone[c]]; a < q->alts.start[cone[c] + 1];
+         a++) {
+      int p = q->alts.adj[a], *rhs = g->rhs + g->prod_off[p];
+
+      m += g->prod_len[p];
+
+      for (int j = 0; j < g->prod_len[p]; j++) {
+        int s = rhs[j] - 1;
+
+        if (!bits_test(g->sym_terminal, s) &&
+            !bits_test(q->empty_done, g->dense[s]))
+          cone_add(q->local, cone, &nc, g->dense[s]);
+      }
+    }
+  }
+
+  int *src = (int*) mem_alloc(g, MEM_TEMP, (m + 1) * sizeof(int));
+  int *dst = (int*) mem_alloc(g, MEM_TEMP, (m + 1) * sizeof(int));
+  int *work = (int*) mem_alloc(g, MEM_TEMP, (nc + 1) * sizeof(int));
+
+  if (!g->status) {
+    for (int c = 0; c < nc; c++)
+      bits_clear(g->sym_empty, g->nonterms[cone[c]] - 1);
+
+    /* count the symbols of each production not known to derive epsilon,
+     * relating the unsettled ones to the production.
+     */
+    for (int c = 0; c < nc && !work_step(g, g->nonterms[cone[c]]); c++) {
+      for (int a = q->alts.start[cone[c]]; a < q->alts.start[cone[c] + 1];
+           a++) {
+        int p = q->alts.adj[a], *rhs = g->rhs + g->prod_off[p];
+
+        g->prod_yield[p] = 0;
+        bits_clear(g->prod_empty, p);
+
+        for (int j = 0; j < g->prod_len[p]; j++) {
+          int s = rhs[j] - 1;
+
+          if (bits_test(g->sym_empty, s))
+            continue;
+
+          g->prod_yield[p]++;
+
+          if (!bits_test(g->sym_terminal, s) && q->local[g->dense[s]] >= 0) {
+            src[k] = q->local[g->dense[s]];
+            dst[k++] = p;
+          }
+        }
+      }
+    }
+  }
+
+  if (!g->status && !relation_build(g, &occ, nc, k, src, dst)) {
+    for (int c = 0; c < nc; c++) {
+      for (int a = q->alts.start[cone[c]]; a < q->alts.start[cone[c] + 1];
+           a++)
+        query_empty_prod(q, q->alts.adj[a], work, &n_work);
+    }
+
+    while (n_work) {
+      int i = work[--n_work];
+
+      for (int j = occ.start[i]; j < occ.start[i + 1]; j++) {
+        g->prod_yield[occ.adj[j]]--;
+        query_empty_prod(q, occ.adj[j], work, &n_work);
+      }
+    }
+
+    for (int c = 0; c < nc; c++)
+      bits_set(q->empty_done, cone[c]);
+  }
+
+  cone_reset(q->local, cone, nc);
+  relation_free(g, &occ);
+  mem_free(g, cone);
+  mem_free(g, src);
+  mem_free(g, dst);
+  mem_free(g, work);
+
+  grammar_phase(g, phase);
+  return g->status;
+}
+
+/* query_first_set(): compute the first set of the nonterminal of dense
+ * index @x, and of every nonterminal in its cone: those reached through
+ * the leading symbols of their productions.
+ */
+static int query_first_set (struct query *q, int x) {
+  grammar_t *g = q->g;
+  struct relation r = { NULL, NULL };
+  int w = bits_words(g->n_terms), nc = 0, m = 0, k = 0, phase = g->phase;
+
+  if (g->status || bits_test(q->first_done, x) || query_empty(q, x))
+    return g->status;
+
+  grammar_phase(g, PHASE_FIRST);
+
+  int *cone = (int*)
+    mem_alloc(g, MEM_TEMP, (g->n_nonterms + 1) * sizeof(int));
+  if (!cone)
+    return g->status;
+
+  cone_add(q->local, cone, &nc, x);
+
+  for (int c = 0; c < nc; c++) {
+    for (int a = q->alts.start[cone[c]]; a < q->alts.start[cone[c] + 1];
+         a++) {
+      int p = q->alts.adj[a], *rhs = g->rhs + g->prod_off[p];
+
+      for (int j = 0; j < g->prod_len[p]; j++) {
+        int s = rhs[j] - 1;
+
+        if (bits_test(g->sym_terminal, s))
+          break;
+
+        m++;
+        if (!bits_test(q->first_done, g->dense[s]))
+          cone_add(q->local, cone, &nc, g->dense[s]);
+
+        if (!bits_test(g->sym_empty, s))
+          break;
+      }
+    }
+  }
+
+  bits_t *F = sets_alloc(g, nc, w);
+  int *src = (int*) mem_alloc(g, MEM_TEMP, (m + 1) * sizeof(int));
+  int *dst = (int*) mem_alloc(g, MEM_TEMP, (m + 1) * sizeof(int));
+
+  for (int c = 0; c < nc && !work_step(g, g->nonterms[cone[c]]); c++) {
+    for (int a = q->alts.start[cone[c]]; a < q->alts.start[cone[c] + 1];
+         a++) {
+      int p = q->alts.adj[a], *rhs = g->rhs + g->prod_off[p];
+
+      for (int j = 0; j < g->prod_len[p]; j++) {
+        int s = rhs[j] - 1, d = g->dense[s];
+
+        if (bits_test(g->sym_terminal, s)) {
+          bits_set(F + c * w, d);
+          break;
+        }
+
+        if (bits_test(q->first_done, d))
+          sets_pack(g, F + c * w, g->symbols[s].first);
+        else {
+          src[k] = c;
+          dst[k++] = q->local[d];
+        }
+
+        if (!bits_test(g->sym_empty, s))
+          break;
+      }
+    }
+  }
+
+  if (!g->status && !relation_build(g, &r, nc, k, src, dst) &&
+      !digraph(g, nc, &r, F, w, NULL)) {
+    for (int c = 0; c < nc && !g->status; c++) {
+      struct symbol *sym = g->symbols + g->nonterms[cone[c]] - 1;
+
+      sym->first = sets_unpack(g, MEM_FIRST, F + c * w, w);
+      bits_set(q->first_done, cone[c]);
+    }
+  }
+
+  cone_reset(q->local, cone, nc);
+  relation_free(g, &r);
+  mem_free(g, cone);
+  mem_free(g, F);
+  mem_free(g, src);
+  mem_free(g, dst);
+
+  grammar_phase(g, phase);
+  return g->status;
+}
+
+/* query_follow_set(): compute the follow set of the nonterminal of dense
+ * index @x, and of every nonterminal in its cone: the left-hand sides of
+ * the productions in which a member of the cone occurs with nothing but
+ * symbols deriving epsilon after it.
+ */
+static int query_follow_set (struct query *q, int x) {
+  grammar_t *g = q->g;
+  struct relation r = { NULL, NULL };
+  int w = bits_words(g->n_terms), nc = 0, m = 0, k = 0, phase = g->phase;
+
+  if (g->status || bits_test(q->follow_done, x) || query_occ(q))
+    return g->status;
+
+  grammar_phase(g, PHASE_FOLLOW);
+
+  int *cone = (int*)
+    mem_alloc(g, MEM_TEMP, (g->n_nonterms + 1) * sizeof(int));
+  if (!cone)
+    return g->status;
+
+  cone_add(q->up, cone, &nc, x);
+
+  for (int c = 0; c < nc && !g->status; c++) {
+    int sym = g->nonterms[cone[c]];
+
+    for (int o = q->occ.start[cone[c]]; o < q->occ.start[cone[c] + 1];
+         o++) {
+      int p = q->occ.adj[o], *rhs = g->rhs + g->prod_off[p];
+      int lhs = g->dense[g->prod_lhs[p] - 1], allempty = 1;
+
+      /* walk right to left, settling whether the tail derives epsilon. */
+      for (int j = g->prod_len[p] - 1; j >= 0 && !g->status; j--) {
+        int s = rhs[j] - 1;
+
+        if (rhs[j] == sym) {
+          m++;
+          if (allempty && !bits_test(q->follow_done, lhs))
+            cone_add(q->up, cone, &nc, lhs);
+        }
+
+        if (allempty && !bits_test(g->sym_terminal, s))
+          allempty = (!query_empty(q, g->dense[s]) &&
+                      bits_test(g->sym_empty, s));
+        else
+          allempty = allempty && bits_test(g->sym_empty, s);
+      }
+    }
+  }
+
+  bits_t *F = sets_alloc(g, nc, w);
+  int *src = (int*) mem_alloc(g, MEM_TEMP, (m + 1) * sizeof(int));
+  int *dst = (int*) mem_alloc(g, MEM_TEMP, (m + 1) * sizeof(int));
+
+  for (int c = 0; c < nc && !work_step(g, g->nonterms[cone[c]]); c++) {
+    int sym = g->nonterms[cone[c]];
+
+    for (int o = q->occ.start[cone[c]]; o < q->occ.start[cone[c] + 1];
+         o++) {
+      int p = q->occ.adj[o], *rhs = g->rhs + g->prod_off[p];
+      int len = g->prod_len[p], allempty = 1;
+      int lhs = g->prod_lhs[p] - 1;
+
+      for (int j = len - 1; j >= 0 && !g->status; j--) {
+        int s = rhs[j] - 1;
+
+        /* the first sets of the symbols after the occurrence, up to the
+         * first that does not derive epsilon.
+         */
+        for (int t = j + 1; rhs[j] == sym && t < len && !g->status; t++) {
+          int next = rhs[t] - 1;
+
+          if (bits_test(g->sym_terminal, next)) {
+            bits_set(F + c * w, g->dense[next]);
+            break;
+          }
+
+          if (!query_first_set(q, g->dense[next]))
+            sets_pack(g, F + c * w, g->symbols[next].first);
+
+          if (!bits_test(g->sym_empty, next))
+            break;
+        }
+
+        if (rhs[j] == sym && allempty) {
+          if (q->up[g->dense[lhs]] >= 0) {
+            src[k] = c;
+            dst[k++] = q->up[g->dense[lhs]];
+          }
+          else
+            sets_pack(g, F + c * w, g->symbols[lhs].follow);
+        }
+
+        allempty = allempty && bits_test(g->sym_empty, s);
+      }
+    }
+  }
+
+  if (!g->status && !relation_build(g, &r, nc, k, src, dst) &&
+      !digraph(g, nc, &r, F, w, NULL)) {
+    for (int c = 0; c < nc && !g->status; c++) {
+      struct symbol *sym = g->symbols + g->nonterms[cone[c]] - 1;
+
+      if (q->eps >= 0)
+        bits_clear(F + c * w, q->eps);
+
+      sym->follow = sets_unpack(g, MEM_FOLLOW, F + c * w, w);
+      bits_set(q->follow_done, cone[c]);
+    }
+  }
+
+  cone_reset(q->up, cone, nc);
+  relation_free(g, &r);
+  mem_free(g, cone);
+  mem_free(g, F);
+  mem_free(g, src);
+  mem_free(g, dst);
+
+  grammar_phase(g, phase);
+  return g->status;
+}
+
+/* query_predict(): compute the predict set of production @p, from the
+ * first sets along its right-hand side and, if it derives epsilon, the
+ * follow set of its left-hand side.
+ */
+static int query_predict (struct query *q, int p) {
+  grammar_t *g = q->g;
+  int w = bits_words(g->n_terms);
+  int lhs = g->prod_lhs[p] - 1, *rhs = g->rhs + g->prod_off[p];
+
+  if (g->status || bits_test(q->predict_done, p) ||
+      query_empty(q, g->dense[lhs]))
+    return g->status;
+
+  bits_t *P = sets_alloc(g, 1, w);
+
+  for (int j = 0; j < g->prod_len[p] && !g->status; j++) {
+    int s = rhs[j] - 1;
+
+    if (bits_test(g->sym_terminal, s)) {
+      bits_set(P, g->dense[s]);
+      break;
+    }
+
+    if (!query_first_set(q, g->dense[s]))
+      sets_pack(g, P, g->symbols[s].first);
+
+    if (!bits_test(g->sym_empty, s))
+      break;
+  }
+
+  if (bits_test(g->prod_empty, p) && !query_follow_set(q, g->dense[lhs]))
+    sets_pack(g, P, g->symbols[lhs].follow);
+
+  if (!g->status) {
+    int phase = g->phase;
+
+    grammar_phase(g, PHASE_PREDICT);
+
+    if (q->eps >= 0)
+      bits_clear(P, q->eps);
+
+    g->prods[p].predict = sets_unpack(g, MEM_PREDICT, P, w);
+    bits_set(q->predict_done, p);
+
+    grammar_phase(g, phase);
+  }
+
+  mem_free(g, P);
+  return g->status;
+}
+
+/* query_first(): get the first set of the one-based symbol @sym,
+ * computing only what it depends on.
+ */
+const int *query_first (struct query *q, int sym) {
+  grammar_t *g = q->g;
+
+  if (sym < 1 || sym > g->n_symbols || g->status)
+    return NULL;
+
+  if (!bits_test(g->sym_terminal, sym - 1)) {
+    query_first_set(q, g->dense[sym - 1]);
+    return g->symbols[sym - 1].first;
+  }
+
+  /* the first set of a terminal is the terminal itself. */
+  if (!g->symbols[sym - 1].first) {
+    g->symbols[sym - 1].first = symv_intern(g, MEM_FIRST, symv_new(g, sym));
+  }
+
+  return g->symbols[sym - 1].first;
+}
+
+/* query_follow(): get the follow set of the one-based symbol @sym,
+ * computing only what it depends on. terminals have none.
+ */
+const int *query_follow (struct query *q, int sym) {
+  grammar_t *g = q->g;
+
+  if (sym < 1 || sym > g->n_symbols || g->status ||
+      bits_test(g->sym_terminal, sym - 1))
+    return NULL;
+
+  query_follow_set(q, g->dense[sym - 1]);
+  return g->symbols[sym - 1].follow;
+}
+
+/* query_check(): add to the @n pairs of overlapping predict sets found
+ * so far those between productions of the one-based nonterminal @sym,
+ * printing them if @print is set, and return the sum. only the predict
+ * sets of @sym are computed.
+ */
+int query_check (struct query *q, int sym, int n, bool print) {
+  grammar_t *g = q->g;
+
+  if (sym < 1 || sym > g->n_symbols || bits_test(g->sym_terminal, sym - 1))
+    return n;
+
+  int x = g->dense[sym - 1];
+  int a0 = q->alts.start[x], a1 = q->alts.start[x + 1];
+
+  for (int a = a0; a < a1 && !g->status; a++)
+    query_predict(q, q->alts.adj[a]);
+
+  if (g->status)
+    return n;
+
+  grammar_phase(g, PHASE_CONFLICTS);
+
+  for (int i = a0; i < a1 && !g->status; i++) {
+    int j1 = q->alts.adj[i];
+
+    for (int j = i + 1; j < a1 && !work_step(g, sym); j++) {
+      int j2 = q->alts.adj[j];
+      int *pred1 = g->prods[j1].predict, *pred2 = g->prods[j2].predict;
+      int *u = (pred1 == pred2 ? NULL : symv_intersect(g, pred1, pred2));
+      int *overlap = (pred1 == pred2 ? pred1 : u);
+
+      if (symv_len(overlap)) {
+        if (print && n == 0)
+          printf("Conflicts:\n\n");
+
+        if (print)
+          conflicts_print(g, j1, j2, overlap);
+
+        n++;
+      }
+
+      mem_free(g, u);
+    }
+  }
+
+  return n;
+}
@@ -0,0 +1,37 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include "grammar.h"
+#include "engine.h"
+
+/* data structure for holding the state of lazy queries against the
+ * grammar @g. productions are indexed by left-hand side (@alts) and by
+ * the nonterminals occurring in them (@occ), both by dense index, and
+ * the nullable flags and sets already final are marked in @empty_done,
+ * @first_done and @follow_done (by dense nonterminal index) and in
+ * @predict_done (by production).
+ */
+struct query {
+  grammar_t *g;
+
+  struct relation alts, occ;
+
+  /* dense index of the epsilon terminal, or -1. */
+  int eps;
+
+  bits_t *empty_done, *first_done, *follow_done, *predict_done;
+
+  /* positions of nonterminals in the cone being solved, or -1: @local
+   * for nullable flags and first sets, @up for follow sets.
+   */
+  int *local, *up;
+};
+
+/* pre-declare lazy query functions. */
+int query_init (struct query *q, grammar_t* g, bool analyzed);
+void query_free (struct query *q);
+const int *query_first (struct query *q, int sym);
+const int *query_follow (struct query *q, int sym);
+int query_check (struct query *q, int sym, int n, bool print);
+
+#endif
@@ -0,0 +1,731 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "server.h"
+#include "main.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* maximum number of members accepted in a single request object. */
+#define SERVER_MAX_MEMBERS 8
+
+/* data structure for holding one member of a flat json request object.
+ * string values are unescaped into @value, and other scalars, which
+ * must be json numbers, true, false or null, are kept as their literal
+ * text.
+ */
+struct member {
+  char *key, *value;
+  int is_string;
+};
+
+/* data structure for holding the state of the query server: the resident
+ * grammar and the indices that make queries against it cheap.
+ */
+struct server {
+  /* @g: resident grammar, valid when @loaded is set. queries fill in its
+   * sets as they go, so each request is answered holding @lock.
+   */
+  grammar_t g;
+  int loaded;
+  pthread_mutex_t lock;
+
+  /* @index: open-addressed hash table of one-based symbol indices,
+   * keyed by symbol name and having @n_index slots.
+   */
+  int *index, n_index;
+
+  /* @alts: zero-based production indices grouped by left-hand side.
+   * productions of symbol @s are @alts[@alt_start[s - 1]] up to
+   * @alts[@alt_start[s] - 1].
+   */
+  int *alts, *alt_start;
+};
+
+/* name_hash(): compute the fnv-1a hash of a symbol name.
+ */
+static unsigned int name_hash (const char *s) {
+  unsigned int h = 2166136261u;
+
+  while (*s)
+    h = (h ^ (unsigned char) *s++) * 16777619u;
+
+  return h;
+}
+
+/* server_reset(): release the resident grammar and its indices.
+ */
+static void server_reset (struct server *srv) {
+  if (srv->loaded)
+    grammar_free(&srv->g);
+
+  free(srv->index);
+  free(srv->alts);
+  free(srv->alt_start);
+
+  srv->index = srv->alts = srv->alt_start = NULL;
+  srv->n_index = 0;
+  srv->loaded = 0;
+}
+
+/* server_index(): build the symbol name index and production groups of
+ * the resident grammar.
+ */
+static int server_index (struct server *srv) {
+  grammar_t *g = &srv->g;
+  int i, n = grammar_n_symbols(g);
+
+  for (srv->n_index = 16; srv->n_index < 2 * n; srv->n_index *= 2);
+
+  srv->index = (int*) calloc(srv->n_index, sizeof(int));
+  srv->alts = (int*) calloc(grammar_n_prods(g) + 1, sizeof(int));
+  srv->alt_start = (int*) calloc(n + 1, sizeof(int));
+
+  if (!srv->index || !srv->alts || !srv->alt_start)
+    return grammar_fail(g, LL1_ENOMEM, "unable to allocate server index");
+
+  for (i = 1; i <= n; i++) {
+    unsigned int h = name_hash(grammar_symbol_name(g, i));
+
+    while (srv->index[h & (srv->n_index - 1)])
+      h++;
+
+    srv->index[h & (srv->n_index - 1)] = i;
+  }
+
+  /* counting sort of the productions by left-hand side. the group ends
+   * are computed first, and filling each group from its end backwards
+   * leaves @alt_start[s - 1] at the start of the group of symbol @s.
+   */
+  for (i = 0; i < grammar_n_prods(g); i++)
+    srv->alt_start[grammar_prod_lhs(g, i) - 1]++;
+
+  for (i = 1; i <= n; i++)
+    srv->alt_start[i] += srv->alt_start[i - 1];
+
+  for (i = grammar_n_prods(g) - 1; i >= 0; i--)
+    srv->alts[--srv->alt_start[grammar_prod_lhs(g, i) - 1]] = i;
+
+  return LL1_OK;
+}
+
+/* server_find(): get the one-based index of the symbol having @name in
+ * the resident grammar, or zero if no such symbol exists.
+ */
+static int server_find (struct server *srv, const char *name) {
+  unsigned int h = name_hash(name);
+  int sym;
+
+  while ((sym = srv->index[h & (srv->n_index - 1)])) {
+    if (strcmp(grammar_symbol_name(&srv->g, sym), name) == 0)
+      return sym;
+
+    h++;
+  }
+
+  return 0;
+}
+
+/* json_skip(): advance past any whitespace in a json text.
+ */
+static const char *json_skip (const char *s) {
+  while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n')
+    s++;
+
+  return s;
+}
+
+/* json_string(): parse a json string starting at the opening quote @s
+ * into a newly allocated, unescaped @out. returns the position after the
+ * closing quote, or NULL on malformed input.
+ */
+static const char *json_string (const char *s, char **out) {
+  size_t n = 0;
+  char *buf = (char*) malloc(strlen(s) + 1);
+
+  if (!buf || *s++ != '"') {
+    free(buf);
+    return NULL;
+  }
+
+  while (*s && *s != '"') {
+    char c = *s++;
+
+    if (c == '\\') {
+      switch (c = *s++) {
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'n': c = '\n'; break;
+        case 'r': c = '\r'; break;
+        case 't': c = '\t'; break;
+        case '"': case '\\': case '/': break;
+
+        case 'u': {
+          unsigned int cp = 0;
+          int i;
+
+          /* exactly four hex digits, naming a nonzero ascii code. */
+          for (i = 0; i < 4 && isxdigit((unsigned char) s[i]); i++)
+            cp = 16 * cp + (isdigit((unsigned char) s[i]) ? s[i] - '0'
+                            : tolower((unsigned char) s[i]) - 'a' + 10);
+
+          if (i < 4 || cp == 0 || cp > 0x7f) {
+            free(buf);
+            return NULL;
+          }
+
+          c = (char) cp;
+          s += 4;
+          break;
+        }
+
+        default:
+          free(buf);
+          return NULL;
+      }
+    }
+
+    buf[n++] = c;
+  }
+
+  if (*s != '"') {
+    free(buf);
+    return NULL;
+  }
+
+  buf[n] = '\0';
+  *out = buf;
+  return s + 1;
+}
+
+/* json_literal(): get the position after the json number, true, false
+ * or null literal starting at @s, or NULL if there is none.
+ */
+static const char *json_literal (const char *s) {
+  static const char *words[] = { "true", "false", "null" };
+
+  for (int i = 0; i < 3; i++) {
+    size_t len = strlen(words[i]);
+
+    if (strncmp(s, words[i], len) == 0 && !isalnum((unsigned char) s[len]))
+      return s + len;
+  }
+
+  if (*s == '-')
+    s++;
+
+  if (*s == '0')
+    s++;
+  else if (isdigit((unsigned char) *s)) {
+    while (isdigit((unsigned char) *s))
+      s++;
+  }
+  else
+    return NULL;
+
+  if (*s == '.') {
+    if (!isdigit((unsigned char) *++s))
+      return NULL;
+
+    while (isdigit((unsigned char) *s))
+      s++;
+  }
+
+  if (*s == 'e' || *s == 'E') {
+    if (*++s == '+' || *s == '-')
+      s++;
+
+    if (!isdigit((unsigned char) *s))
+      return NULL;
+
+    while (isdigit((unsigned char) *s))
+      s++;
+  }
+
+  return (isalnum((unsigned char) *s) || *s == '.' ? NULL : s);
+}
+
+/* json_parse(): parse a flat json object of scalar members into @mv,
+ * storing the number of parsed members into @n. returns zero on success
+ * or -1 on malformed input. the parsed members must be freed either way.
+ */
+static int json_parse (const char *s, struct member *mv, int *n) {
+  *n = 0;
+
+  s = json_skip(s);
+  if (*s++ != '{')
+    return -1;
+
+  s = json_skip(s);
+  if (*s == '}')
+    return 0;
+
+  while (*n < SERVER_MAX_MEMBERS) {
+    struct member *m = mv + *n;
+
+    s = json_string(json_skip(s), &m->key);
+    if (!s)
+      return -1;
+
+    m->value = NULL;
+    (*n)++;
+
+    s = json_skip(s);
+    if (*s++ != ':')
+      return -1;
+
+    s = json_skip(s);
+    m->is_string = (*s == '"');
+
+    if (m->is_string) {
+      s = json_string(s, &m->value);
+    }
+    else {
+      const char *end = json_literal(s);
+      if (!end)
+        return -1;
+
+      m->value = strndup(s, end - s);
+      s = end;
+    }
+
+    if (!s || !m->value)
+      return -1;
+
+    s = json_skip(s);
+    if (*s == '}')
+      return 0;
+
+    if (*s++ != ',')
+      return -1;
+  }
+
+  return -1;
+}
+
+/* json_member(): get the member named @key, or NULL.
+ */
+static struct member *json_member (struct member *mv, int n,
+                                   const char *key) {
+  for (int i = 0; i < n; i++) {
+    if (strcmp(mv[i].key, key) == 0)
+      return mv + i;
+  }
+
+  return NULL;
+}
+
+/* json_get(): get the value of the member named @key, or NULL.
+ */
+static const char *json_get (struct member *mv, int n, const char *key) {
+  struct member *m = json_member(mv, n, key);
+  return (m ? m->value : NULL);
+}
+
+/* json_put_string(): write @s to @out as an escaped json string.
+ */
+static void json_put_string (FILE *out, const char *s) {
+  fputc('"', out);
+
+  for (; *s; s++) {
+    unsigned char c = *s;
+
+    if (c == '"' || c == '\\')
+      fprintf(out, "\\%c", c);
+    else if (c < 0x20)
+      fprintf(out, "\\u%04x", c);
+    else
+      fputc(c, out);
+  }
+
+  fputc('"', out);
+}
+
+/* json_put_symv(): write a symbol array to @out as a json array of
+ * symbol names.
+ */
+static void json_put_symv (FILE *out, grammar_t* g, const int *sv) {
+  fputc('[', out);
+
+  for (int i = 0; i < symv_len(sv); i++) {
+    if (i) fputc(',', out);
+    json_put_string(out, grammar_symbol_name(g, sv[i]));
+  }
+
+  fputc(']', out);
+}
+
+/* json_put_scalar(): write the value of the member @m to @out, as an
+ * escaped json string or as the literal that json_parse() accepted.
+ */
+static void json_put_scalar (FILE *out, struct member *m) {
+  if (m->is_string)
+    json_put_string(out, m->value);
+  else if (json_literal(m->value) == m->value + strlen(m->value))
+    fputs(m->value, out);
+  else
+    fputs("null", out);
+}
+
+/* reply_begin(): begin a response object, echoing the request @id.
+ */
+static void reply_begin (FILE *out, struct member *id, int ok) {
+  fprintf(out, "{");
+
+  if (id) {
+    fprintf(out, "\"id\":");
+    json_put_scalar(out, id);
+    fputc(',', out);
+  }
+
+  fprintf(out, "\"ok\":%s", ok ? "true" : "false");
+}
+
+/* reply_error(): write a complete error response.
+ */
+static void reply_error (FILE *out, struct member *id, const char *msg) {
+  reply_begin(out, id, 0);
+  fprintf(out, ",\"error\":");
+  json_put_string(out, msg);
+  fprintf(out, "}\n");
+}
+
+/* server_load(): parse and analyze a grammar from a file named @fname or
+ * from the grammar @text, replacing the resident grammar on success.
+ */
+static int server_load (struct server *srv, const char *fname,
+                        const char *text, char *err, size_t n_err) {
+  struct server next = { .loaded = 1 };
+  grammar_t *g = &next.g;
+
+  grammar_init(g);
+
+  if (fname)
+    grammar_parse_file(g, fname);
+  else
+    grammar_parse_buffer(g, "<request>", text, strlen(text));
+
+  if (g->status || derives_empty(g) || first(g) || follow(g) ||
+      predict(g) || server_index(&next)) {
+    snprintf(err, n_err, "%s", grammar_error(g));
+    server_reset(&next);
+    return -1;
+  }
+
+  server_reset(srv);
+  *srv = next;
+  return 0;
+}
+
+/* server_conflicts(): write the predict set overlaps between the
+ * productions of nonterminal @sym as json objects. when @tok is nonzero,
+ * only overlaps containing that terminal are written. returns the number
+ * of objects written after @n previous ones.
+ */
+static int server_conflicts (FILE *out, struct server *srv, int sym,
+                             int tok, int n) {
+  grammar_t *g = &srv->g;
+  int lo = srv->alt_start[sym - 1], hi = srv->alt_start[sym];
+
+  for (int a = lo; a < hi; a++) {
+    for (int b = a + 1; b < hi; b++) {
+      const int *p1 = grammar_predict(g, srv->alts[a]);
+      const int *p2 = grammar_predict(g, srv->alts[b]);
+      int k = 0, *overlap;
+
+      overlap = (int*) malloc((symv_len(p1) + 1) * sizeof(int));
+      if (!overlap)
+        continue;
+
+      for (int i = 0; i < symv_len(p1); i++) {
+        for (int j = 0; j < symv_len(p2); j++) {
+          if (p1[i] == p2[j] && (!tok || p1[i] == tok))
+            overlap[k++] = p1[i];
+        }
+      }
+
+      overlap[k] = 0;
+
+      if (k) {
+        fprintf(out, "%s{\"lhs\":", n++ ? "," : "");
+        json_put_string(out, grammar_symbol_name(g, sym));
+        fprintf(out, ",\"productions\":[%d,%d],\"rhs\":[",
+                srv->alts[a], srv->alts[b]);
+        json_put_symv(out, g, grammar_prod_rhs(g, srv->alts[a]));
+        fputc(',', out);
+        json_put_symv(out, g, grammar_prod_rhs(g, srv->alts[b]));
+        fprintf(out, "],\"overlap\":");
+        json_put_symv(out, g, overlap);
+        fputc('}', out);
+      }
+
+      free(overlap);
+    }
+  }
+
+  return n;
+}
+
+/* op_free(): free the @n members of a parsed request.
+ */
+static void op_free (struct member *mv, int n) {
+  for (int i = 0; i < n; i++) {
+    free(mv[i].key);
+    free(mv[i].value);
+  }
+}
+
+/* server_request(): answer a single request line.
+ */
+static void server_request (struct server *srv, const char *line,
+                            FILE *out) {
+  struct member mv[SERVER_MAX_MEMBERS];
+  char err[LL1_ERRMSG_MAX + 64];
+  int n, sym = 0, tok = 0;
+
+  if (json_parse(line, mv, &n)) {
+    reply_error(out, NULL, "malformed request");
+    op_free(mv, n);
+    return;
+  }
+
+  struct member *id = json_member(mv, n, "id");
+  const char *op = json_get(mv, n, "op");
+  const char *name = json_get(mv, n, "symbol");
+  const char *token = json_get(mv, n, "token");
+  grammar_t *g = &srv->g;
+
+  if (!op) {
+    reply_error(out, id, "missing \"op\" member");
+  }
+  else if (strcmp(op, "load") == 0) {
+    const char *fname = json_get(mv, n, "file");
+    const char *text = json_get(mv, n, "text");
+
+    if (!fname == !text)
+      reply_error(out, id, "load requires one of \"file\" or \"text\"");
+    else if (server_load(srv, fname, text, err, sizeof(err)))
+      reply_error(out, id, err);
+    else {
+      reply_begin(out, id, 1);
+      fprintf(out, ",\"symbols\":%d,\"productions\":%d,\"conflicts\":%d}\n",
+              grammar_n_symbols(&srv->g), grammar_n_prods(&srv->g),
+              conflicts_count(&srv->g));
+    }
+  }
+  else if (!srv->loaded) {
+    reply_error(out, id, "no grammar loaded");
+  }
+  else if (name && !(sym = server_find(srv, name))) {
+    snprintf(err, sizeof(err), "unknown symbol \"%s\"", name);
+    reply_error(out, id, err);
+  }
+  else if (token && !(tok = server_find(srv, token))) {
+    snprintf(err, sizeof(err), "unknown symbol \"%s\"", token);
+    reply_error(out, id, err);
+  }
+  else if (strcmp(op, "conflicts") == 0) {
+    int k = 0;
+
+    reply_begin(out, id, 1);
+    fprintf(out, ",\"conflicts\":[");
+
+    for (int s = 1; s <= grammar_n_symbols(g); s++) {
+      if ((!sym || s == sym) && !grammar_is_terminal(g, s))
+        k = server_conflicts(out, srv, s, tok, k);
+    }
+
+    fprintf(out, "]}\n");
+  }
+  else if (!sym) {
+    reply_error(out, id, "missing \"symbol\" member");
+  }
+  else if (strcmp(op, "first") == 0 || strcmp(op, "follow") == 0) {
+    reply_begin(out, id, 1);
+    fprintf(out, ",\"set\":");
+    json_put_symv(out, g, op[1] == 'i' ? grammar_first(g, sym)
+                                       : grammar_follow(g, sym));
+    fprintf(out, "}\n");
+  }
+  else if (strcmp(op, "nullable") == 0) {
+    reply_begin(out, id, 1);
+    fprintf(out, ",\"nullable\":%s}\n",
+            grammar_nullable(g, sym) ? "true" : "false");
+  }
+  else if (strcmp(op, "predict") == 0) {
+    reply_begin(out, id, 1);
+    fprintf(out, ",\"productions\":[");
+
+    for (int a = srv->alt_start[sym - 1]; a < srv->alt_start[sym]; a++) {
+      fprintf(out, "%s{\"production\":%d,\"rhs\":",
+              a > srv->alt_start[sym - 1] ? "," : "", srv->alts[a]);
+      json_put_symv(out, g, grammar_prod_rhs(g, srv->alts[a]));
+      fprintf(out, ",\"predict\":");
+      json_put_symv(out, g, grammar_predict(g, srv->alts[a]));
+      fputc('}', out);
+    }
+
+    fprintf(out, "]}\n");
+  }
+  else {
+    snprintf(err, sizeof(err), "unknown op \"%s\"", op);
+    reply_error(out, id, err);
+  }
+
+  op_free(mv, n);
+}
+
+/* server_serve(): answer newline-delimited requests from @in on @out
+ * until the end of input, or until a reply cannot be written. replies are
+ * built in memory and written once the server is unlocked, so a client
+ * that is slow to read holds up no other.
+ */
+static void server_serve (struct server *srv, FILE *in, FILE *out) {
+  char *line = NULL, *reply = NULL;
+  size_t n_line = 0, n_reply = 0;
+
+  while (getline(&line, &n_line, in) > 0) {
+    if (*json_skip(line) == '\0')
+      continue;
+
+    FILE *fh = open_memstream(&reply, &n_reply);
+    if (!fh)
+      break;
+
+    pthread_mutex_lock(&srv->lock);
+    server_request(srv, line, fh);
+    pthread_mutex_unlock(&srv->lock);
+
+    fclose(fh);
+    fwrite(reply, 1, n_reply, out);
+    free(reply);
+    reply = NULL;
+
+    if (fflush(out) != 0 || ferror(out))
+      break;
+  }
+
+  free(line);
+}
+
+/* data structure for holding one connection to the socket server: the
+ * server @srv and the connected socket @fd.
+ */
+struct conn {
+  struct server *srv;
+  int fd;
+};
+
+/* server_conn(): serve the requests of the connection @arg, and close
+ * it at their end.
+ */
+static void *server_conn (void *arg) {
+  struct conn *c = (struct conn*) arg;
+
+  FILE *in = fdopen(c->fd, "r");
+  FILE *out = fdopen(dup(c->fd), "w");
+
+  if (in && out)
+    server_serve(c->srv, in, out);
+
+  if (in) fclose(in); else close(c->fd);
+  if (out) fclose(out);
+
+  free(c);
+  return NULL;
+}
+
+/* server_preload(): load the grammar file @fname, if any, before serving
+ * requests.
+ */
+static void server_preload (struct server *srv, const char *fname) {
+  char err[LL1_ERRMSG_MAX];
+
+  if (fname && server_load(srv, fname, NULL, err, sizeof(err)))
+    derp("%s", err);
+}
+
+/* server_run_stdio(): serve requests read from stdin, writing responses
+ * to stdout.
+ */
+int server_run_stdio (const char *fname) {
+  struct server srv = { .loaded = 0 };
+
+  pthread_mutex_init(&srv.lock, NULL);
+  server_preload(&srv, fname);
+  server_serve(&srv, stdin, stdout);
+  server_reset(&srv);
+  pthread_mutex_destroy(&srv.lock);
+
+  return 0;
+}
+
+/* server_run_socket(): listen on the unix socket @path and serve the
+ * requests of each connection on a thread of its own. the resident
+ * grammar is shared by all connections, whose requests are answered one
+ * at a time.
+ */
+int server_run_socket (const char *fname, const char *path) {
+  struct server srv = { .loaded = 0 };
+  struct sockaddr_un addr;
+  pthread_attr_t attr;
+  pthread_t tid;
+
+  pthread_mutex_init(&srv.lock, NULL);
+  server_preload(&srv, fname);
+
+  if (strlen(path) >= sizeof(addr.sun_path))
+    derp("%s: socket path too long", path);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    derp("socket: %s", strerror(errno));
+
+  /* a client leaving before its replies are written only ends its
+   * own connection.
+   */
+  signal(SIGPIPE, SIG_IGN);
+
+  unlink(path);
+  if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 ||
+      listen(fd, 8) != 0)
+    derp("%s: %s", path, strerror(errno));
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  while (1) {
+    int conn = accept(fd, NULL, NULL);
+    if (conn < 0) {
+      if (errno == EINTR)
+        continue;
+
+      derp("accept: %s", strerror(errno));
+    }
+
+    struct conn *c = (struct conn*) malloc(sizeof(struct conn));
+    if (c) {
+      c->srv = &srv;
+      c->fd = conn;
+    }
+
+    if (!c || pthread_create(&tid, &attr, server_conn, c) != 0) {
+      close(conn);
+      free(c);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "grammar.h"
+
+/* pre-declare query server functions. */
+int server_run_stdio (const char *fname);
+int server_run_socket (const char *fname, const char *path);
+
+#endif